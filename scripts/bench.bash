@@ -0,0 +1,89 @@
+#!/bin/bash
+
+# Performance regression suite, run by "make bench": starts pong_server on
+# loopback, runs a fixed matrix of sizes and modes and compares the RTTs
+# and the run times of the clients with the baseline in
+# ../data/bench_baseline.dat. With -b the results become the new baseline.
+
+set -e
+
+Threshold=10
+RecordBaseline=0
+while getopts "bt:" opt ; do
+	case $opt in
+	b) RecordBaseline=1 ;;
+	t) Threshold=$OPTARG ;;
+	*) printf "\nUsage: bench.bash [-b] [-t THRESHOLD-PERCENT]\n\n" ; exit 1 ;;
+	esac
+done
+
+readonly BinDir=../bin
+readonly DataDir=../data
+readonly Baseline=${DataDir}/bench_baseline.dat
+readonly Current=${DataDir}/bench_current.dat
+readonly FirstPort=${BENCH_PORT:-15700}
+readonly Runs=10			# client runs per configuration, after a warm-up run
+readonly Repetitions=501	# ping-pongs per run
+
+# NAME CLIENT OPTIONS SIZE: the matrix, in result file order
+readonly Matrix=(
+	"tcp_64 tcp_ping - 64"
+	"tcp_1024 tcp_ping - 1024"
+	"tcp_32768 tcp_ping - 32768"
+	"tcp_64_r4096 tcp_ping -r4096 64"
+	"udp_64 udp_ping - 64"
+	"udp_1024 udp_ping - 1024"
+	"udp_8192 udp_ping - 8192"
+	"udp_64_ts udp_ping -t 64"
+)
+
+ServerPid=
+cleanup() {
+	[[ -n ${ServerPid} ]] && kill ${ServerPid} 2>/dev/null || true
+}
+trap cleanup EXIT
+
+# the server has no SO_REUSEADDR: skip ports still in TIME_WAIT
+for ((Port = FirstPort; Port < FirstPort + 20; Port++)) ; do
+	${BinDir}/pong_server ${Port} 2>/dev/null &
+	ServerPid=$!
+	sleep 0.2
+	kill -0 ${ServerPid} 2>/dev/null && break
+	ServerPid=
+done
+if [[ -z ${ServerPid} ]] ; then printf "\nError: cannot start pong_server on ports %d-%d\n\n" ${FirstPort} $((Port - 1)) ; exit 1; fi
+
+Output=${Current}
+[[ ${RecordBaseline} == 1 ]] && Output=${Baseline}
+{
+	echo "# pingpong bench: CONFIG METRIC RUN VALUE (rtt and wall in ms)"
+	echo "# $(date -u +%FT%TZ) $(git describe --always --dirty 2>/dev/null || echo unknown) $(uname -srm)"
+} > ${Output}
+for entry in "${Matrix[@]}" ; do
+	read -r Name Client Options Size <<< "${entry}"
+	[[ ${Options} == - ]] && Options=
+	printf "%-16s" ${Name}
+	for ((run = 0; run <= Runs; run++)) ; do
+		Start=$(date +%s%N)
+		${BinDir}/${Client} ${Options} 127.0.0.1 ${Port} ${Size} ${Repetitions} > ${Output}.tmp
+		End=$(date +%s%N)
+		[[ ${run} == 0 ]] && continue
+		awk -v name=${Name} -v run=${run} '/^Round trip time was/ { print name, "rtt", run, $5 }' ${Output}.tmp >> ${Output}
+		awk -v name=${Name} -v run=${run} -v ns=$((End - Start)) 'BEGIN { print name, "wall", run, ns / 1e6 }' >> ${Output}
+		printf "."
+	done
+	printf "\n"
+done
+rm -f ${Output}.tmp
+
+if [[ ${RecordBaseline} == 1 ]] ; then
+	printf "\nBaseline recorded in %s\n" ${Baseline}
+	exit 0
+fi
+if [[ ! -r ${Baseline} ]] ; then
+	cp ${Current} ${Baseline}
+	printf "\nNo baseline yet: these results are now the baseline (%s)\n" ${Baseline}
+	exit 0
+fi
+printf "\n"
+${BinDir}/bench_compare -t ${Threshold} ${Baseline} ${Current}
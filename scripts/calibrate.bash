@@ -0,0 +1,115 @@
+#!/bin/bash
+
+# Checks that tcp_ping and udp_ping report the latency, bandwidth and loss
+# injected by pingpong_relay on localhost. Each impaired run is compared
+# with a run through a relay that injects nothing, so that the cost of the
+# relay itself cancels out.
+
+set -e
+
+if [[ $# > 1 ]] ; then printf "\nError: optional first TCP port number expected as a parameter\n\n" ; exit 1; fi
+
+readonly BasePort=${1:-15600}
+readonly BinDir=../bin
+readonly Delay=1000		# one-way delay, us
+readonly Jitter=200		# uniform jitter, us
+readonly Rate=100M		# bottleneck, bit/s
+readonly RateBits=100000000
+readonly BulkSize=65536		# TCP message size for the bandwidth check
+readonly LossPct=5
+readonly LossCount=5000
+
+declare -a Pids
+NextPort=$((BasePort + 1))
+Failures=0
+
+cleanup() {
+	kill ${Pids[@]} 2>/dev/null || true
+}
+trap cleanup EXIT
+
+# start_relay OPTIONS...: starts a relay on a new port, stored in RelayPort
+start_relay() {
+	local port=$NextPort
+	NextPort=$((NextPort + 1))
+	${BinDir}/pingpong_relay "$@" ${port} 127.0.0.1 ${BasePort} 2>/dev/null &
+	Pids+=($!)
+	sleep 0.2
+	RelayPort=${port}
+}
+
+# field NAME: value following "NAME: " in the standard input
+field() {
+	grep -o "$1: [0-9.e+-]*" | head -n 1 | awk "{ print \$NF }"
+}
+
+# check LABEL MEASURED EXPECTED TOLERANCE
+check() {
+	if awk -v m="$2" -v e="$3" -v t="$4" 'BEGIN { d = m - e; exit !(d <= t && -d <= t) }' ; then
+		printf "PASS  %-44s measured %10.4g, expected %10.4g +- %.3g\n" "$1" "$2" "$3" "$4"
+	else
+		printf "FAIL  %-44s measured %10.4g, expected %10.4g +- %.3g\n" "$1" "$2" "$3" "$4"
+		Failures=$((Failures + 1))
+	fi
+}
+
+# bound EXPECTED: 5% of the expected value plus 0.05 ms
+bound() {
+	awk -v e="$1" 'BEGIN { print (e < 0 ? -e : e) * 0.05 + 0.05 }'
+}
+
+${BinDir}/pong_server ${BasePort} 2>/dev/null &
+Pids+=($!)
+sleep 0.2
+
+start_relay
+readonly PlainPort=${RelayPort}
+start_relay --delay ${Delay}
+readonly DelayPort=${RelayPort}
+start_relay --delay ${Delay} --jitter ${Jitter} --distribution uniform --seed 1
+readonly JitterPort=${RelayPort}
+start_relay --rate ${Rate}
+readonly RatePort=${RelayPort}
+start_relay --loss ${LossPct} --seed 1
+readonly LossPort=${RelayPort}
+
+Expected=$(awk -v d=${Delay} 'BEGIN { print 2 * d / 1000 }')
+for proto in tcp udp ; do
+	Plain=$(${BinDir}/${proto}_ping 127.0.0.1 ${PlainPort} 64 501 | grep "^RTT :" | field median)
+	Delayed=$(${BinDir}/${proto}_ping 127.0.0.1 ${DelayPort} 64 501 | grep "^RTT :" | field median)
+	Delta=$(awk -v a=${Delayed} -v b=${Plain} 'BEGIN { print a - b }')
+	check "${proto} median RTT increase, delay ${Delay} us (ms)" ${Delta} ${Expected} $(bound ${Expected})
+done
+
+# two uniform jitters in [-J, J] add up to a triangular RTT noise:
+# its 10th-90th percentile spread is 2 * (2 - 2 * sqrt(0.2)) * J
+Output=$(${BinDir}/udp_ping 127.0.0.1 ${JitterPort} 64 1501)
+P10=$(echo "${Output}" | grep "^RTT :" | field "percentile 10")
+P90=$(echo "${Output}" | grep "^RTT :" | field "percentile 90")
+Spread=$(awk -v a=${P90} -v b=${P10} 'BEGIN { print a - b }')
+ExpectedSpread=$(awk -v j=${Jitter} 'BEGIN { print 2 * (2 - 2 * sqrt(0.2)) * j / 1000 }')
+check "udp RTT p10-p90 spread, jitter ${Jitter} us (ms)" ${Spread} ${ExpectedSpread} \
+	$(awk -v e=${ExpectedSpread} 'BEGIN { print e * 0.15 + 0.05 }')
+
+# each message crosses the bottleneck once per direction
+Plain=$(${BinDir}/tcp_ping 127.0.0.1 ${PlainPort} ${BulkSize} 101 | grep "^RTT :" | field median)
+Limited=$(${BinDir}/tcp_ping 127.0.0.1 ${RatePort} ${BulkSize} 101 | grep "^RTT :" | field median)
+Delta=$(awk -v a=${Limited} -v b=${Plain} 'BEGIN { print a - b }')
+Expected=$(awk -v s=${BulkSize} -v r=${RateBits} 'BEGIN { print 2 * s * 8 / r * 1000 }')
+check "tcp ${BulkSize} B RTT increase, rate ${Rate}bit/s (ms)" ${Delta} ${Expected} $(bound ${Expected})
+
+# binomial loss: three standard deviations
+Output=$(${BinDir}/udp_ping -l -i 0.2 127.0.0.1 ${LossPort} 64 ${LossCount})
+Uplink=$(echo "${Output}" | grep "uplink" | sed 's/.*lost [0-9]* (\([0-9.e+-]*\)%).*/\1/')
+Roundtrip=$(echo "${Output}" | grep "round trip:" | sed 's/.*lost [0-9]* (\([0-9.e+-]*\)%).*/\1/')
+check "udp uplink loss, ${LossPct}% injected (%)" ${Uplink} ${LossPct} \
+	$(awk -v p=${LossPct} -v n=${LossCount} 'BEGIN { p /= 100; print 300 * sqrt(p * (1 - p) / n) }')
+Expected=$(awk -v p=${LossPct} 'BEGIN { p /= 100; print 100 * (1 - (1 - p) * (1 - p)) }')
+check "udp round trip loss, ${LossPct}% each way (%)" ${Roundtrip} ${Expected} \
+	$(awk -v e=${Expected} -v n=${LossCount} 'BEGIN { p = e / 100; print 300 * sqrt(p * (1 - p) / n) }')
+
+if [[ ${Failures} != 0 ]] ; then
+	printf "\n%d calibration checks failed\n" ${Failures}
+	exit 1
+fi
+printf "\nAll calibration checks passed\n"
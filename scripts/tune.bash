@@ -0,0 +1,98 @@
+#!/bin/bash
+
+# Socket option tuning matrix: runs the same ping-pong with every
+# combination of the given option alternatives (tcp_ping/udp_ping
+# --sockopt, applied by both ends through the request) and prints them
+# ranked by p99 (or p50, or throughput), so that the settings of a service
+# can be chosen from measurements.
+#
+# Every AXIS is a list of alternatives separated by "/", "-" standing for
+# no option, e.g.
+#   ./tune.bash seti.dibris.unige.it 1491 nodelay=0/nodelay - /quickack \
+#	sndbuf=65536/sndbuf=1048576/- tos=0x10/-
+# tries 2 x 2 x 3 x 2 = 24 combinations.
+
+set -e
+
+Protocol=tcp
+Size=64
+Runs=3
+Repetitions=1001
+SortBy=p99
+while getopts "P:s:n:r:k:" opt ; do
+	case $opt in
+	P) Protocol=$OPTARG ;;
+	s) Size=$OPTARG ;;
+	n) Runs=$OPTARG ;;
+	r) Repetitions=$OPTARG ;;
+	k) SortBy=$OPTARG ;;
+	*) printf "\nUsage: tune.bash [-P tcp|udp] [-s SIZE] [-n RUNS] [-r REPETITIONS] [-k p50|p99|tput] IP-ADDR PORT AXIS...\n\n" ; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+if [[ $# -lt 3 ]] ; then printf "\nError: IpAddr Port and at least one AXIS expected as parameters\n\n" ; exit 1; fi
+case ${Protocol} in tcp|udp) ;; *) printf "\nError: protocol must be tcp or udp\n\n" ; exit 1 ;; esac
+case ${SortBy} in p50|p99|tput) ;; *) printf "\nError: sort key must be p50, p99 or tput\n\n" ; exit 1 ;; esac
+
+readonly BinDir=../bin
+readonly IpAddr=$1
+readonly Port=$2
+shift 2
+readonly Tmp=$(mktemp -d)
+trap "rm -rf ${Tmp}" EXIT
+
+# Cartesian product of the axes: one comma-separated option list per
+# combination, "-" for the defaults
+Combinations=("")
+for axis in "$@" ; do
+	IFS=/ read -r -a alternatives <<< "${axis}"
+	next=()
+	for c in "${Combinations[@]}" ; do
+		for a in "${alternatives[@]}" ; do
+			if [[ ${a} == - ]] ; then next+=("${c}")
+			elif [[ -z ${c} ]] ; then next+=("${a}")
+			else next+=("${c},${a}")
+			fi
+		done
+	done
+	Combinations=("${next[@]}")
+done
+printf "%d combinations, %d runs of %d %s ping-pongs of %d bytes each\n" ${#Combinations[@]} ${Runs} ${Repetitions} ${Protocol} ${Size}
+
+# runs are interleaved, so that a slow period of the network does not
+# penalize a single combination
+for ((run = 1; run <= Runs; run++)) ; do
+	for ((i = 0; i < ${#Combinations[@]}; i++)) ; do
+		c=${Combinations[$i]}
+		if ${BinDir}/${Protocol}_ping ${c:+--sockopt ${c}} ${IpAddr} ${Port} ${Size} ${Repetitions} > ${Tmp}/run.out 2>&1 ; then
+			awk '/^Round trip time was/ { print $5 }' ${Tmp}/run.out >> ${Tmp}/rtt_${i}
+		else
+			tail -1 ${Tmp}/run.out > ${Tmp}/failed_${i}
+		fi
+		printf "."
+	done
+done
+printf "\n\n"
+
+# OPTIONS P50 P99 TPUT: throughput in KB/s of messages and answers at the mean RTT
+for ((i = 0; i < ${#Combinations[@]}; i++)) ; do
+	c=${Combinations[$i]}
+	if [[ -s ${Tmp}/rtt_${i} ]] ; then
+		sort -g ${Tmp}/rtt_${i} | awk -v opts="${c:-defaults}" -v size=${Size} \
+			'{ v[NR] = $1; sum += $1 }
+			 END { p99 = int(NR * 0.99) + 1; if (p99 > NR) p99 = NR
+			       printf "%s %.6f %.6f %.1f\n", opts, v[int(NR / 2) + 1], v[p99], 2 * size * NR / sum }'
+	else
+		printf "%s failed: %s\n" "${c:-defaults}" "$(cat ${Tmp}/failed_${i} 2>/dev/null)" >> ${Tmp}/failures
+	fi
+done > ${Tmp}/table
+
+case ${SortBy} in
+p50) SortKeys="-k2,2g -k3,3g" ;;
+p99) SortKeys="-k3,3g -k2,2g" ;;
+tput) SortKeys="-k4,4gr -k3,3g" ;;
+esac
+printf "%4s %-48s %12s %12s %12s\n" rank options "p50 (ms)" "p99 (ms)" "KB/s"
+sort ${SortKeys} ${Tmp}/table | awk '{ printf "%4d %-48s %12.6f %12.6f %12.1f\n", NR, $1, $2, $3, $4 }'
+[[ -s ${Tmp}/failures ]] && printf "\n" && cat ${Tmp}/failures
+exit 0
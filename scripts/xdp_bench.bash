@@ -0,0 +1,123 @@
+#!/bin/bash
+
+# Compares the UDP RTT of pong_server's socket path with its AF_XDP fast
+# path (pong_server -x), in native and in generic (SKB) mode, on a veth
+# pair: pong_server runs on one end, udp_ping in a network namespace on
+# the other end. Needs root (ip netns, BPF). Prints the median RTT of each
+# path for every message size.
+
+set -e
+
+Runs=5
+Repetitions=1001
+FirstPort=${XDP_BENCH_PORT:-15800}
+while getopts "n:r:p:" opt ; do
+	case $opt in
+	n) Runs=$OPTARG ;;
+	r) Repetitions=$OPTARG ;;
+	p) FirstPort=$OPTARG ;;
+	*) printf "\nUsage: xdp_bench.bash [-n RUNS] [-r REPETITIONS] [-p FIRST-PORT]\n\n" ; exit 1 ;;
+	esac
+done
+
+readonly BinDir=../bin
+readonly Sizes=(16 64 256 1024 1400)
+readonly NetNs=pp_xdp
+readonly Veth=ppx0
+readonly PeerVeth=ppx1
+readonly ServerAddr=10.199.0.1
+readonly ClientAddr=10.199.0.2
+readonly Tmp=$(mktemp -d)
+
+ServerPid=
+stop_server() {
+	local engine
+	if [[ -n ${ServerPid} ]] ; then
+		engine=$(pgrep -P ${ServerPid} || true)
+		kill ${ServerPid} 2>/dev/null || true
+		wait ${ServerPid} 2>/dev/null || true
+		# the XDP engine follows the server: the queue is free some time after it is gone
+		for pid in ${engine} ; do
+			while kill -0 ${pid} 2>/dev/null ; do sleep 0.1 ; done
+		done
+		[[ -n ${engine} ]] && sleep 1
+		ServerPid=
+	fi
+}
+cleanup() {
+	stop_server
+	ip link del ${Veth} 2>/dev/null || true
+	ip netns del ${NetNs} 2>/dev/null || true
+	rm -rf ${Tmp}
+}
+trap cleanup EXIT
+
+ip netns add ${NetNs}
+ip link add ${Veth} type veth peer name ${PeerVeth} netns ${NetNs}
+ip addr add ${ServerAddr}/24 dev ${Veth}
+ip link set ${Veth} up
+ip -n ${NetNs} addr add ${ClientAddr}/24 dev ${PeerVeth}
+ip -n ${NetNs} link set ${PeerVeth} up
+ip -n ${NetNs} link set lo up
+
+# start_server PORT OPTIONS...: the server has no SO_REUSEADDR, every run
+# uses a new port
+start_server() {
+	local port=$1
+	shift
+	${BinDir}/pong_server "$@" ${port} 2> ${Tmp}/server.log &
+	ServerPid=$!
+	sleep 0.5
+	if ! kill -0 ${ServerPid} 2>/dev/null ; then
+		printf "\nError: cannot start pong_server on port %d\n\n" ${port}
+		cat ${Tmp}/server.log
+		exit 1
+	fi
+	if [[ $# -gt 0 ]] && grep -q "no AF_XDP" ${Tmp}/server.log ; then
+		cat ${Tmp}/server.log
+		exit 1
+	fi
+}
+
+# measure PATH PORT: every RTT sample of every run, one file per size
+measure() {
+	local path=$1 port=$2 size run
+	for size in "${Sizes[@]}" ; do
+		for ((run = 0; run <= Runs; run++)) ; do
+			ip netns exec ${NetNs} ${BinDir}/udp_ping ${ServerAddr} ${port} ${size} ${Repetitions} > ${Tmp}/run.out
+			[[ ${run} == 0 ]] && continue	# warm-up
+			awk '/^Round trip time was/ { print $5 }' ${Tmp}/run.out >> ${Tmp}/${path}_${size}
+		done
+		printf "."
+	done
+}
+
+median() {
+	sort -g $1 | awk '{ v[NR] = $1 } END { print NR ? (NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2) : "-" }'
+}
+
+Port=${FirstPort}
+Paths=(socket native generic)
+for path in "${Paths[@]}" ; do
+	printf "%-8s" ${path}
+	case ${path} in
+	socket) start_server ${Port} ;;
+	native) start_server ${Port} -x ${Veth} ;;
+	generic) start_server ${Port} -x ${Veth} -G ;;
+	esac
+	head -1 ${Tmp}/server.log | grep XDP | sed 's/^/ /' || true
+	measure ${path} ${Port}
+	printf "\n"
+	stop_server
+	Port=$((Port + 1))
+done
+
+printf "\nMedian UDP RTT (ms), %d runs of %d ping-pongs per size\n" ${Runs} ${Repetitions}
+printf "%8s %10s %10s %10s %9s %9s\n" size socket native generic "native%" "generic%"
+for size in "${Sizes[@]}" ; do
+	s=$(median ${Tmp}/socket_${size})
+	n=$(median ${Tmp}/native_${size})
+	g=$(median ${Tmp}/generic_${size})
+	awk -v size=${size} -v s=${s} -v n=${n} -v g=${g} \
+		'BEGIN { printf "%8d %10.6f %10.6f %10.6f %+8.1f%% %+8.1f%%\n", size, s, n, g, 100 * (n - s) / s, 100 * (g - s) / s }'
+done
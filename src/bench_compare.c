@@ -0,0 +1,254 @@
+/*
+ * bench_compare.c: confronta i risultati di "make bench" con quelli di
+ *                  riferimento (baseline) e segnala i peggioramenti
+ *                  statisticamente significativi, usando il test di
+ *                  Mann-Whitney e intervalli di confidenza bootstrap su
+ *                  mediana e percentile 99.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <getopt.h>
+#include "pingpong.h"
+
+#define MAXSETS 128		/* configuration/metric pairs in a result file */
+#define MAXRUNS 256		/* client runs of a configuration */
+#define MINTAILSAMPLES 100	/* fewer samples say nothing about the p99 */
+#define BOOTSTRAP_SEED 0x5eed
+
+/* All the samples of one metric of one configuration, e.g. "tcp_64 rtt" */
+struct sample_set {
+	char config[64], metric[16];
+	int n, cap;
+	double *v;		/* in file order: the samples of a run are contiguous */
+	double *sorted;
+	int n_runs, last_run;
+	int run_start[MAXRUNS + 1];
+};
+
+static struct sample_set *find_set(struct sample_set sets[], int n_sets, const char *config, const char *metric)
+{
+	int i;
+	for (i = 0; i < n_sets; i++)
+		if (strcmp(sets[i].config, config) == 0 && strcmp(sets[i].metric, metric) == 0)
+			return &sets[i];
+	return NULL;
+}
+
+/*
+ * Reads a result file of "CONFIG METRIC RUN VALUE" lines ('#' starts a
+ * comment) and returns the number of sample sets.
+ */
+int read_results(const char *path, struct sample_set sets[MAXSETS])
+{
+	char line[256], config[64], metric[16];
+	double value;
+	int n_sets = 0, i, run;
+	struct sample_set *s;
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL)
+		fail_errno(path);
+	while (fgets(line, sizeof line, f)) {
+		if (line[0] == '#' || sscanf(line, "%63s %15s %d %lf", config, metric, &run, &value) != 4)
+			continue;
+		if ((s = find_set(sets, n_sets, config, metric)) == NULL) {
+			if (n_sets == MAXSETS)
+				fail("Too many configurations in a bench result file");
+			s = &sets[n_sets++];
+			memset(s, 0, sizeof *s);
+			strcpy(s->config, config);
+			strcpy(s->metric, metric);
+			s->last_run = run - 1;
+		}
+		if (run != s->last_run) {
+			if (s->n_runs == MAXRUNS)
+				fail("Too many runs of a configuration in a bench result file");
+			s->run_start[s->n_runs++] = s->n;
+			s->last_run = run;
+		}
+		if (s->n == s->cap) {
+			s->cap = s->cap ? 2 * s->cap : 1024;
+			if ((s->v = realloc(s->v, (size_t)s->cap * sizeof(double))) == NULL)
+				fail_errno("Cannot allocate bench samples");
+		}
+		s->v[s->n++] = value;
+	}
+	fclose(f);
+	for (i = 0; i < n_sets; i++) {
+		struct sample_set *s = &sets[i];
+		s->run_start[s->n_runs] = s->n;
+		if ((s->sorted = malloc((size_t)s->n * sizeof(double))) == NULL)
+			fail_errno("Cannot allocate bench samples");
+		memcpy(s->sorted, s->v, (size_t)s->n * sizeof(double));
+		qsort(s->sorted, (size_t)s->n, sizeof(double), double_cmp);
+	}
+	return n_sets;
+}
+
+/* Same percentile definition as print_percentiles(), on sorted samples */
+static double percentile(const double *sorted, int n, int pct)
+{
+	return sorted[(pct * n) / 100];
+}
+
+/*
+ * One-sided Mann-Whitney U test, normal approximation with tie and
+ * continuity corrections: the probability of a rank sum of "cur" at
+ * least this high if both samples came from the same distribution.
+ */
+double mann_whitney_p(const struct sample_set *base, const struct sample_set *cur)
+{
+	const double n1 = cur->n, n2 = base->n, n = n1 + n2;
+	double rank_sum = 0.0, ties = 0.0, u, mean, var;
+	int i = 0, j = 0;
+
+	while (i < base->n || j < cur->n) {
+		/* next value and how many times it appears in either sample */
+		double x = (j == cur->n || (i < base->n && base->sorted[i] < cur->sorted[j])) ? base->sorted[i] : cur->sorted[j];
+		int in_base = 0, in_cur = 0;
+		double first_rank = i + j + 1, t, avg_rank;
+		while (i < base->n && base->sorted[i] == x)
+			i++, in_base++;
+		while (j < cur->n && cur->sorted[j] == x)
+			j++, in_cur++;
+		t = in_base + in_cur;
+		avg_rank = first_rank + (t - 1.0) / 2.0;
+		rank_sum += in_cur * avg_rank;
+		ties += t * t * t - t;
+	}
+	u = rank_sum - n1 * (n1 + 1.0) / 2.0;
+	mean = n1 * n2 / 2.0;
+	var = n1 * n2 / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+	if (var <= 0.0)
+		return 1.0;
+	return 0.5 * erfc((u - mean - 0.5) / sqrt(var) / M_SQRT2);
+}
+
+/* One two-stage bootstrap resample: runs with replacement, then samples
+   with replacement within each chosen run, so that the noise between runs
+   (cache and frequency state, scheduling) widens the interval as it should */
+static void resample(const struct sample_set *s, double *out, unsigned short rand_state[3])
+{
+	int k = 0, r, i;
+	for (r = 0; r < s->n_runs; r++) {
+		const int run = (int)(erand48(rand_state) * s->n_runs);
+		const int start = s->run_start[run], len = s->run_start[run + 1] - start;
+		for (i = 0; i < len && k < s->n; i++)
+			out[k++] = s->v[start + (int)(erand48(rand_state) * len)];
+	}
+	while (k < s->n)	/* runs of different lengths */
+		out[k++] = s->v[(int)(erand48(rand_state) * s->n)];
+	qsort(out, (size_t)s->n, sizeof(double), double_cmp);
+}
+
+/*
+ * Bootstrap confidence interval of the relative change (cur / base - 1)
+ * of a percentile: both samples are resampled "resamples" times, and
+ * [lo, hi] is the central (1 - 2 alpha) interval.
+ */
+void bootstrap_change(const struct sample_set *base, const struct sample_set *cur, int pct,
+		      int resamples, double alpha, unsigned short rand_state[3], double *lo, double *hi)
+{
+	double *change = malloc((size_t)resamples * sizeof(double));
+	double *b = malloc((size_t)base->n * sizeof(double)), *c = malloc((size_t)cur->n * sizeof(double));
+	int r;
+
+	if (change == NULL || b == NULL || c == NULL)
+		fail_errno("Cannot allocate bootstrap buffers");
+	for (r = 0; r < resamples; r++) {
+		resample(base, b, rand_state);
+		resample(cur, c, rand_state);
+		change[r] = percentile(c, cur->n, pct) / percentile(b, base->n, pct) - 1.0;
+	}
+	qsort(change, (size_t)resamples, sizeof(double), double_cmp);
+	*lo = change[(int)(alpha * (resamples - 1))];
+	*hi = change[(int)((1.0 - alpha) * (resamples - 1))];
+	free(change);
+	free(b);
+	free(c);
+}
+
+int main(int argc, char **argv)
+{
+	static struct sample_set base[MAXSETS], cur[MAXSETS];
+	unsigned short rand_state[3] = { 0x330e, BOOTSTRAP_SEED, 0 };
+	double threshold = 0.10, alpha = 0.01;
+	int resamples = 1000, n_base, n_cur, i, opt, regressions = 0;
+
+	while ((opt = getopt(argc, argv, "t:a:n:")) != -1)
+		switch (opt) {
+		case 't':
+			threshold = atof(optarg) / 100.0;
+			break;
+		case 'a':
+			alpha = atof(optarg);
+			break;
+		case 'n':
+			resamples = atoi(optarg);
+			break;
+		default:
+			fail("Bench compare incorrect syntax. Use: bench_compare [-t PCT] [-a ALPHA] [-n RESAMPLES] BASELINE CURRENT");
+		}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc != 3 || threshold < 0.0 || alpha <= 0.0 || alpha >= 0.5 || resamples < 10)
+		fail("Bench compare incorrect syntax. Use: bench_compare [-t PCT] [-a ALPHA] [-n RESAMPLES] BASELINE CURRENT");
+	n_base = read_results(argv[1], base);
+	n_cur = read_results(argv[2], cur);
+
+	printf("Regression threshold %lg%%, significance %lg, %d bootstrap resamples\n\n", threshold * 100.0, alpha, resamples);
+	printf("%-16s %-5s %9s %9s %8s %19s %9s %9s %8s %19s %9s  %s\n", "config", "metric",
+	       "base med", "cur med", "change", "CI", "base p99", "cur p99", "change", "CI", "MW p", "verdict");
+	for (i = 0; i < n_base; i++) {
+		const struct sample_set *b = &base[i], *c = find_set(cur, n_cur, b->config, b->metric);
+		double med_b, med_c, p99_b, p99_c, med_lo, med_hi, p99_lo = 0.0, p99_hi = 0.0, p;
+		int tail, slower;
+		if (c == NULL || c->n < 2 || b->n < 2) {
+			printf("%-16s %-5s missing from one of the result files\n", b->config, b->metric);
+			continue;
+		}
+		med_b = percentile(b->sorted, b->n, 50);
+		med_c = percentile(c->sorted, c->n, 50);
+		p99_b = percentile(b->sorted, b->n, 99);
+		p99_c = percentile(c->sorted, c->n, 99);
+		p = mann_whitney_p(b, c);
+		bootstrap_change(b, c, 50, resamples, alpha, rand_state, &med_lo, &med_hi);
+		tail = b->n >= MINTAILSAMPLES && c->n >= MINTAILSAMPLES;
+		if (tail)
+			bootstrap_change(b, c, 99, resamples, alpha, rand_state, &p99_lo, &p99_hi);
+		/* a significant median shift above the threshold, or a p99 shift
+		   above the threshold with confidence: the tail is much noisier */
+		slower = (p < alpha && med_lo > 0.0 && med_c / med_b - 1.0 > threshold) ||
+			 (tail && p99_lo > threshold);
+		regressions += slower;
+		printf("%-16s %-5s %9.4lg %9.4lg %+7.1lf%% [%+7.1lf%%,%+7.1lf%%]", b->config, b->metric,
+		       med_b, med_c, 100.0 * (med_c / med_b - 1.0), 100.0 * med_lo, 100.0 * med_hi);
+		if (tail)
+			printf(" %9.4lg %9.4lg %+7.1lf%% [%+7.1lf%%,%+7.1lf%%]",
+			       p99_b, p99_c, 100.0 * (p99_c / p99_b - 1.0), 100.0 * p99_lo, 100.0 * p99_hi);
+		else
+			printf(" %9s %9s %8s %19s", "-", "-", "-", "-");
+		printf(" %9.2lg  %s\n", p, slower ? "REGRESSION" : "ok");
+	}
+	if (regressions) {
+		printf("\n%d configurations are significantly slower than the baseline\n", regressions);
+		return EXIT_FAILURE;
+	}
+	printf("\nNo significant regression\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+/*
+ * histogram.c: istogramma dei RTT a memoria costante (bucket logaritmici)
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "pingpong.h"
+
+/*
+ * Values (nanoseconds) below HIST_SUB_BUCKETS have a bucket each; above,
+ * every power of two is split into HIST_SUB_BUCKETS buckets, so that the
+ * relative error of any percentile is below 1 / HIST_SUB_BUCKETS whatever
+ * the number of samples. Values beyond 2^HIST_MAX_BITS ns end up in the
+ * last bucket (min and max stay exact).
+ */
+
+int hist_bucket(int64_t ns)
+{
+	int msb, shift;
+	if (ns < HIST_SUB_BUCKETS)
+		return ns < 0 ? 0 : (int)ns;
+	msb = 63 - __builtin_clzll((unsigned long long)ns);
+	if (msb >= HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+	shift = msb - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB_BUCKETS + (int)(ns >> shift) - HIST_SUB_BUCKETS;
+}
+
+/* midpoint of the values falling into bucket idx */
+int64_t hist_bucket_value(int idx)
+{
+	int shift;
+	if (idx < HIST_SUB_BUCKETS)
+		return idx;
+	shift = idx / HIST_SUB_BUCKETS - 1;
+	return ((int64_t)(HIST_SUB_BUCKETS + idx % HIST_SUB_BUCKETS) << shift) + ((int64_t)1 << shift) / 2;
+}
+
+void hist_init(struct latency_hist *h)
+{
+	memset(h, 0, sizeof *h);
+	h->min_ns = INT64_MAX;
+}
+
+void hist_add(struct latency_hist *h, int64_t ns)
+{
+	h->buckets[hist_bucket(ns)]++;
+	h->count++;
+	h->sum_ns += (double)ns;
+	if (ns < h->min_ns)
+		h->min_ns = ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+}
+
+/* returns the p-th percentile (0 <= p <= 100) in nanoseconds, 0 if empty */
+int64_t hist_percentile(const struct latency_hist *h, double p)
+{
+	uint64_t rank, seen = 0;
+	int64_t v;
+	int i;
+	if (h->count == 0)
+		return 0;
+	rank = (uint64_t)(p / 100.0 * (double)h->count);
+	if (rank >= h->count)
+		rank = h->count - 1;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > rank)
+			break;
+	}
+	v = hist_bucket_value(i);
+	if (v < h->min_ns)
+		v = h->min_ns;
+	if (v > h->max_ns)
+		v = h->max_ns;
+	return v;
+}
+
+/* same format as print_percentiles(), values in milliseconds */
+void print_hist_percentiles(FILE * outf, const char *label, const struct latency_hist *h)
+{
+	if (h->count == 0) {
+		fprintf(outf, "%s: no samples\n", label);
+		return;
+	}
+	fprintf(outf, "%s: min %lg, percentile 10: %lg, median: %lg, percentile 90: %lg, percentile 99: %lg, max %lg, average: %lg\n",
+		label, h->min_ns / 1e6, hist_percentile(h, 10) / 1e6, hist_percentile(h, 50) / 1e6,
+		hist_percentile(h, 90) / 1e6, hist_percentile(h, 99) / 1e6, h->max_ns / 1e6,
+		h->sum_ns / (double)h->count / 1e6);
+}
+
+void hist_merge(struct latency_hist *dst, const struct latency_hist *src)
+{
+	int i;
+	if (src->count == 0)
+		return;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	dst->count += src->count;
+	dst->sum_ns += src->sum_ns;
+	if (src->min_ns < dst->min_ns)
+		dst->min_ns = src->min_ns;
+	if (src->max_ns > dst->max_ns)
+		dst->max_ns = src->max_ns;
+}
+
+/*
+ * Sketch serialization: a header line
+ *   PPSKETCH 1 PROTOCOL MSG_SIZE RESP_SIZE COUNT MIN_NS MAX_NS SUM_NS NONZERO
+ * followed by a line of NONZERO "BUCKET:COUNT" pairs. Only the non-empty
+ * buckets are written, so a sketch takes a few hundred bytes however many
+ * samples it summarizes, and sketches of any number of runs can be merged
+ * exactly (up to the bucket resolution). Returns 0, or -1 on write errors.
+ */
+int hist_write(FILE * f, const char *protocol, int msg_size, int resp_size, const struct latency_hist *h)
+{
+	int i, nonzero = 0;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		nonzero += h->buckets[i] != 0;
+	fprintf(f, "PPSKETCH %d %s %d %d %llu %lld %lld %.17g %d\n", SKETCH_VERSION, protocol, msg_size, resp_size,
+		(unsigned long long)h->count, (long long)(h->count ? h->min_ns : 0), (long long)h->max_ns, h->sum_ns, nonzero);
+	for (i = 0; i < HIST_BUCKETS; i++)
+		if (h->buckets[i])
+			fprintf(f, "%d:%llu ", i, (unsigned long long)h->buckets[i]);
+	fprintf(f, "\n");
+	return ferror(f) ? -1 : 0;
+}
+
+/* Reads the next sketch of f into h: returns 1, 0 at end of file, -1 if
+   the sketch is malformed or its buckets do not add up to its count */
+int hist_read(FILE * f, char protocol[SKETCH_PROTO_LEN], int *msg_size, int *resp_size, struct latency_hist *h)
+{
+	unsigned long long count, bucket_count, total = 0;
+	long long min_ns, max_ns;
+	int version, nonzero, i, idx;
+
+	hist_init(h);
+	i = fscanf(f, " PPSKETCH %d %7s %d %d %llu %lld %lld %lf %d", &version, protocol, msg_size, resp_size,
+		   &count, &min_ns, &max_ns, &h->sum_ns, &nonzero);
+	if (i == EOF)
+		return 0;
+	if (i != 9 || version != SKETCH_VERSION || nonzero < 0 || nonzero > HIST_BUCKETS)
+		return -1;
+	for (i = 0; i < nonzero; i++) {
+		if (fscanf(f, " %d:%llu", &idx, &bucket_count) != 2 || idx < 0 || idx >= HIST_BUCKETS)
+			return -1;
+		h->buckets[idx] += bucket_count;
+		total += bucket_count;
+	}
+	if (total != count)
+		return -1;
+	h->count = count;
+	if (count) {
+		h->min_ns = min_ns;
+		h->max_ns = max_ns;
+	}
+	return 1;
+}
+
+/* Appends to path the sketch of n RTTs given in milliseconds */
+void save_sketch(const char *path, const char *protocol, int msg_size, int resp_size, int n, const double rtt_ms[n])
+{
+	struct latency_hist *h = malloc(sizeof *h);
+	FILE *f;
+	int i;
+	if (h == NULL)
+		fail("Cannot allocate the RTT sketch");
+	hist_init(h);
+	for (i = 0; i < n; i++)
+		hist_add(h, (int64_t)(rtt_ms[i] * 1e6 + 0.5));
+	if ((f = fopen(path, "a")) == NULL || hist_write(f, protocol, msg_size, resp_size, h) || fclose(f))
+		fail_errno("Cannot write the RTT sketch");
+	free(h);
+}
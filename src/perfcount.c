@@ -0,0 +1,154 @@
+/*
+ * perfcount.c: contatori delle prestazioni (perf_event_open) attorno al
+ *              ciclo di misura di client e server: cicli, istruzioni,
+ *              cache miss, branch miss, cambi di contesto e page fault,
+ *              riportati per ogni round trip. Dove la PMU non e`
+ *              disponibile (ad esempio nelle macchine virtuali) si usano
+ *              i soli eventi software del kernel.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "pingpong.h"
+
+struct perf_event_desc {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+};
+
+/* The first event of each set leads the group */
+static const struct perf_event_desc hw_events[] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+	{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static const struct perf_event_desc sw_events[] = {
+	{ "task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+	{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+	{ "cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+	{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static int open_event(const struct perf_event_desc *d, int group_fd, int exclude_kernel)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof attr);
+	attr.size = sizeof attr;
+	attr.type = d->type;
+	attr.config = d->config;
+	attr.disabled = group_fd < 0;
+	attr.exclude_kernel = (uint64_t)exclude_kernel;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/* Members the kernel does not support are left out, the leader is required */
+static int open_group(struct perf_counters *pc, const struct perf_event_desc *events, int n_events, int exclude_kernel)
+{
+	int i, fd;
+	pc->n = 0;
+	for (i = 0; i < n_events; i++) {
+		if ((fd = open_event(&events[i], pc->n ? pc->fds[0] : -1, exclude_kernel)) < 0) {
+			if (pc->n == 0)
+				return -1;
+			continue;
+		}
+		pc->names[pc->n] = events[i].name;
+		pc->fds[pc->n++] = fd;
+	}
+	pc->exclude_kernel = exclude_kernel;
+	return 0;
+}
+
+/*
+ * Opens the counters of the calling process: the hardware group if the
+ * PMU is there, the software group otherwise. Kernel time is counted too
+ * unless perf_event_paranoid forbids it. Returns 0, or -1 (see errno)
+ * when not even the software events can be opened.
+ */
+int perf_open(struct perf_counters *pc)
+{
+	int exclude_kernel;
+	memset(pc, 0, sizeof *pc);
+	for (exclude_kernel = 0; exclude_kernel <= 1; exclude_kernel++) {
+		if (open_group(pc, hw_events, sizeof hw_events / sizeof hw_events[0], exclude_kernel) == 0) {
+			pc->hardware = 1;
+			return 0;
+		}
+		if (open_group(pc, sw_events, sizeof sw_events / sizeof sw_events[0], exclude_kernel) == 0)
+			return 0;
+		if (errno != EACCES && errno != EPERM)
+			break;
+	}
+	return -1;
+}
+
+void perf_begin(struct perf_counters *pc)
+{
+	if (ioctl(pc->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) ||
+	    ioctl(pc->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP))
+		fail_errno("Cannot start the performance counters");
+}
+
+/* Stops the group and reads it, scaling the counts if it was multiplexed */
+void perf_end(struct perf_counters *pc)
+{
+	uint64_t buf[3 + PERF_MAXEVENTS];
+	int i;
+	if (ioctl(pc->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP))
+		fail_errno("Cannot stop the performance counters");
+	if (read(pc->fds[0], buf, sizeof buf) < (ssize_t)((3 + pc->n) * sizeof(uint64_t)))
+		fail_errno("Cannot read the performance counters");
+	/* buf: number of events, time enabled, time running, then the values */
+	pc->scaled = buf[2] && buf[2] < buf[1];
+	for (i = 0; i < pc->n; i++)
+		pc->values[i] = pc->scaled ? (uint64_t)((double)buf[3 + i] * buf[1] / buf[2]) : buf[3 + i];
+}
+
+void perf_close(struct perf_counters *pc)
+{
+	int i;
+	for (i = 0; i < pc->n; i++)
+		close(pc->fds[i]);
+	pc->n = 0;
+}
+
+void print_perf_counters(FILE * outf, const char *name, const struct perf_counters *pc, int round_trips)
+{
+	int i, cycles = -1, instructions = -1;
+	fprintf(outf, "%s per round trip (%s%s%s):", name, pc->hardware ? "hardware" : "software only",
+		pc->exclude_kernel ? ", user space" : "", pc->scaled ? ", scaled" : "");
+	for (i = 0; i < pc->n; i++) {
+		fprintf(outf, " %s %lg", pc->names[i], (double)pc->values[i] / round_trips);
+		if (strcmp(pc->names[i], "cycles") == 0)
+			cycles = i;
+		else if (strcmp(pc->names[i], "instructions") == 0)
+			instructions = i;
+	}
+	if (cycles >= 0 && instructions >= 0 && pc->values[cycles])
+		fprintf(outf, " IPC %.2lf", (double)pc->values[instructions] / pc->values[cycles]);
+	fprintf(outf, "\n");
+}
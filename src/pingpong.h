@@ -40,12 +40,15 @@
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <assert.h>
+#include <stdint.h>
+#include <endian.h>
 
 #define MINREPEATS 101		/* Min number of tests */
 #define REPEATS 301		/* Default number of tests */
 #define MAXREPEATS 1501		/* Max number of tests */
 #define MINSIZE 16		/* Minimum message size */
-#define LISTENBACKLOG 1
+#define LISTENBACKLOG 128	/* room for connection-rate benchmarks */
+#define TFOQUEUELEN 128		/* TCP Fast Open pending-request queue */
 #define UDP_TIMEOUT ((double)1500.0)	/* 1.5 seconds */
 #define MAXTCPSIZE (1024*1024)	/* 1 MiB */
 #define MAXUDPSIZE 65500
@@ -53,16 +56,99 @@
 #define IANAMINEPHEM 49152
 #define IANAMAXEPHEM 65535
 #define PONGRECVTOUT 10
-#define MAX_REQ 30
-#define MAX_ANSW 10
+#define PONGSESSIONTOUT 300	/* idle timeout of a persistent control session */
+#define SESSION_VERSION 1	/* "SESSION 1" control protocol */
+#define MAX_REQ 256
+#define MAX_ANSW 32
+#define MAXSIZES 64		/* sizes in one session sweep */
 
 extern void fail_errno(const char *const msg);
 extern void fail(const char *const msg);
 extern double timespec_delta2milliseconds(struct timespec *last, struct timespec *previous);
 extern void print_statistics(FILE * outf, const char *name, int repeats,
-			     double rtt[repeats], int msg_sz, double resolution);
+			     double rtt[repeats], int msg_sz, int resp_sz, double resolution);
+extern int double_cmp(const void *p1, const void *p2);
+extern void print_percentiles(FILE * outf, const char *label, int n, double v[n]);
+/* A client's do_ping() as run by the harness self-test, see statistics.c */
+typedef double (*harness_ping)(size_t msg_size, int msg_no, char message[msg_size], int sock,
+			       size_t resp_size, char answer[resp_size], int64_t *send_ns);
+#define HARNESS_MAXSIZE 65536	/* self-test messages fit the socket buffers */
+extern void measure_harness_overhead(int sock_type, size_t msg_size, size_t resp_size, int repeats, harness_ping ping,
+				     double *window_ms, double *iteration_ms);
+extern void print_harness_overhead(FILE * outf, int sock_type, size_t msg_size, size_t resp_size, int repeats,
+				   harness_ping ping);
+extern void print_breakdown(FILE * outf, const char *name, int repeats, const double rtt[repeats],
+			    const int64_t send_ns[repeats], const int64_t server_rx_ns[repeats],
+			    const int64_t server_tx_ns[repeats], int64_t clock_offset, int synced_clocks);
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 41	/* 2^41 ns: about 36 minutes */
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/* Latency histogram of constant size, see histogram.c */
+struct latency_hist {
+	uint64_t count;
+	int64_t min_ns, max_ns;
+	double sum_ns;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+extern int hist_bucket(int64_t ns);
+extern int64_t hist_bucket_value(int idx);
+extern void hist_init(struct latency_hist *h);
+extern void hist_add(struct latency_hist *h, int64_t ns);
+extern int64_t hist_percentile(const struct latency_hist *h, double p);
+extern void print_hist_percentiles(FILE * outf, const char *label, const struct latency_hist *h);
+
+#define SKETCH_VERSION 1	/* "PPSKETCH 1" serialization, see hist_write() */
+#define SKETCH_PROTO_LEN 8
+
+extern void hist_merge(struct latency_hist *dst, const struct latency_hist *src);
+extern int hist_write(FILE * f, const char *protocol, int msg_size, int resp_size, const struct latency_hist *h);
+extern int hist_read(FILE * f, char protocol[SKETCH_PROTO_LEN], int *msg_size, int *resp_size, struct latency_hist *h);
+extern void save_sketch(const char *path, const char *protocol, int msg_size, int resp_size, int n, const double rtt_ms[n]);
+
+#define SEQ_WINDOW 4096		/* sequence numbers remembered to spot duplicates */
+
+/* Loss, duplicates, reordering and jitter of a numbered stream, see seqstats.c */
+struct seq_stats {
+	uint64_t received;	/* distinct sequence numbers */
+	uint64_t duplicates;
+	uint64_t reordered;	/* arrived after a higher sequence number */
+	uint64_t too_late;	/* older than the window, not counted as received */
+	int64_t max_reorder;	/* largest distance below the highest sequence number */
+	int64_t highest;
+	double jitter_ns;	/* RFC 3550 interarrival jitter */
+	int64_t last_transit;
+	uint64_t seen[SEQ_WINDOW / 64];
+};
+
+extern void seq_stats_init(struct seq_stats *st);
+extern void seq_stats_add(struct seq_stats *st, int64_t seq, int64_t transit_ns);
+extern int format_seq_stats(char *buf, size_t n, const struct seq_stats *st);
+extern int parse_seq_stats(const char *buf, struct seq_stats *st);
 
 #define CLOCK_TYPE CLOCK_MONOTONIC
+#define TS_CLOCK_TYPE CLOCK_REALTIME	/* clock of timestamps exchanged between hosts */
+
+/* With "ts=1" the server writes into each reply, after the sequence number,
+   the time the request was fully received and the time the reply started
+   to be sent (TS_CLOCK_TYPE, see put_timestamp()). */
+#define PONG_TS_OFFSET MINSIZE
+#define PONG_TS_MINSIZE (PONG_TS_OFFSET + 2 * (int)sizeof(int64_t))
+
+/* With "loss=1" the client writes its send time (CLOCK_TYPE) here, and
+   the server echoes it back whatever the response size. */
+#define PONG_CLIENT_TS_OFFSET PONG_TS_MINSIZE
+#define LOSS_MINSIZE (PONG_CLIENT_TS_OFFSET + (int)sizeof(int64_t))
+#define LOSS_INTERVAL 10.0	/* default ms between two datagrams of a loss test */
+
+extern int64_t timespec2ns(const struct timespec *ts);
+extern void put_timestamp(char *buf, int64_t ns);
+extern int64_t get_timestamp(const char *buf);
+extern int64_t clock_offset_ns(void);
+extern int64_t now_ns(void);
 
 #ifdef DEBUG
 #define debug(...) printf(__VA_ARGS__)
@@ -73,6 +159,207 @@ extern void print_statistics(FILE * outf, const char *name, int repeats,
 ssize_t read_all(int fd, void *ptr, size_t n);
 ssize_t blocking_write_all(int fd, const void *ptr, size_t n);
 ssize_t nonblocking_write_all(int fd, const void *ptr, size_t n);
+ssize_t read_line(int fd, char *buf, size_t n);
+
+/* Socket options of both ends of a test (--sockopt, "so="), see sockopts.c */
+#define SOCKOPT_NODELAY 0x01
+#define SOCKOPT_QUICKACK 0x02
+#define SOCKOPT_CORK 0x04
+#define SOCKOPT_SNDBUF 0x08
+#define SOCKOPT_RCVBUF 0x10
+#define SOCKOPT_BUSYPOLL 0x20
+#define SOCKOPT_TOS 0x40
+#define SOCKOPT_TCP_ONLY (SOCKOPT_NODELAY | SOCKOPT_QUICKACK | SOCKOPT_CORK)
+#define SOCKOPT_BUFFERS (SOCKOPT_SNDBUF | SOCKOPT_RCVBUF)	/* not in a session: see save_sock_options() */
+#define SOCKOPT_SPEC_MAX 96	/* keeps the request within MAX_REQ */
+
+struct sock_options {
+	unsigned set;		/* SOCKOPT_* given, the others keep the defaults */
+	int nodelay, quickack, cork;
+	int sndbuf, rcvbuf;	/* bytes asked for, the kernel doubles them */
+	int busy_poll_us;
+	int tos;
+};
+
+int parse_sock_options(const char *spec, struct sock_options *so);
+int apply_sock_options(int sock, int is_tcp, const struct sock_options *so);
+int save_sock_options(int sock, const struct sock_options *so, struct sock_options *saved);
+int sock_cork(int sock, const struct sock_options *so, int on);
+int sock_quickack(int sock, const struct sock_options *so);
+
+/* Measurement options a client sends along with its "TCP"/"UDP" requests */
+struct ping_options {
+	int resp_size;		/* -r: size of the answers, 0 for a plain echo */
+	int timestamps;		/* -t: server timestamps in every reply */
+	int synced_clocks;	/* --synced: client and server clocks agree */
+	int loss;		/* -l: UDP loss measurement, never aborts */
+	double interval_ms;	/* -i: time between datagrams of a loss test */
+	const char *sketch_path;	/* -k: append a mergeable RTT sketch of every run */
+	int stream;		/* -b: bulk transfer instead of ping-pong, see STREAM_UP */
+	int stream_ms;		/* -T: duration of the transfer, 0 for a byte count only */
+	long long stream_bytes;	/* -B: bytes to transfer, 0 for a duration only */
+	int report_ms;		/* -i (tcp_ping): interval of the throughput reports */
+	int sendfile;		/* -F: the sender uses sendfile() */
+	const char *stream_file;	/* --file: upload this file with sendfile() */
+	int perf;		/* --perf: performance counters around the ping-pongs */
+	int tcpinfo_every;	/* --tcpinfo: TCP_INFO sample every this many repetitions */
+	const char *congestion;	/* --cc: TCP congestion control algorithm */
+	int variable;		/* --replay: messages of any size up to the requested one */
+	const char *sockopt_spec;	/* --sockopt: socket options of both ends */
+	struct sock_options sockopts;	/* the same, parsed */
+};
+
+int parse_size_list(const char *arg, int sizes[], int max_sizes);
+void build_request(char *request, const char *protocol, int msg_size, int norep, const struct ping_options *opts);
+int response_size(int msg_size, const struct ping_options *opts);
+int start_session(int control_socket);
+void end_session(int control_socket);
+void build_stream_request(char *request, int write_size, const struct ping_options *opts);
+
+#define STREAM_UP 1		/* "STREAM size up": the client sends */
+#define STREAM_DOWN 2		/* "STREAM size down": the server sends */
+#define STREAM_TIME 10000	/* default ms of a transfer */
+#define STREAM_MAXTIME 3600000
+#define STREAM_INTERVAL 1000	/* default ms between two throughput reports */
+#define STREAM_MININTERVAL 10
+#define MAXINTERVALS 3600	/* reports kept by each end of a transfer */
+
+/* How an end of a bulk transfer sends or receives, see stream.c */
+struct stream_params {
+	size_t write_size;	/* bytes per write(), sendfile() or read() */
+	int64_t duration_ns;	/* sender stops after this long, 0 for no limit */
+	uint64_t byte_limit;	/* sender stops after this many bytes, 0 for no limit */
+	int64_t interval_ns;
+	int file_fd;		/* sendfile() source, -1 to write() from memory */
+	off_t file_size;
+};
+
+struct stream_interval {
+	int64_t end_ns;		/* since the start of the transfer */
+	uint64_t bytes;
+	uint32_t retrans;	/* total so far, sender only */
+};
+
+struct stream_stats {
+	uint64_t bytes;
+	int64_t elapsed_ns, cpu_user_ns, cpu_sys_ns;
+	uint32_t retrans;	/* TCP retransmissions, sender only */
+	int n_intervals;
+	struct stream_interval intervals[MAXINTERVALS];
+};
+
+int sendfile_source(size_t size);
+int stream_send(int sock, const struct stream_params *p, struct stream_stats *st);
+int stream_receive(int sock, const struct stream_params *p, struct stream_stats *st);
+int write_stream_report(int fd, const struct stream_stats *st);
+int read_stream_report(int fd, struct stream_stats *st);
+void print_stream_report(FILE * outf, const char *name, const char *sender_name, const char *receiver_name,
+			 const struct stream_stats *sender, const struct stream_stats *receiver);
+
+/* Embeddable probes, see probe.c: errors are returned, never fail()ed */
+#define PROBE_OK 0
+#define PROBE_ESYS (-1)		/* a system call failed, see errno */
+#define PROBE_ERESOLVE (-2)
+#define PROBE_EREFUSED (-3)	/* the server answered "ERROR" */
+#define PROBE_EPROTO (-4)
+#define PROBE_ETIMEOUT (-5)
+#define PROBE_EINVAL (-6)
+#define PROBE_EBROKEN (-7)	/* an earlier run failed half-way */
+
+struct probe_session;
+
+struct probe_result {
+	int count;		/* ping-pongs measured */
+	int resent;		/* UDP datagrams sent again after a timeout */
+	double min_ms, mean_ms, max_ms;
+	double p50_ms, p90_ms, p99_ms, p999_ms;
+	double throughput;	/* KB/s at the median RTT, messages and responses */
+	double residence_p50_ms, residence_p99_ms;	/* with ping_options.timestamps */
+};
+
+int probe_open(struct probe_session **session, const char *host, const char *port, int timeout_ms);
+int probe_run(struct probe_session *s, int is_udp, int msg_size, int count, const struct ping_options *opts,
+	      struct probe_result *res);
+int probe_ping(struct probe_session *s, int is_udp, int msg_size, const struct ping_options *opts, double *rtt_ms);
+void probe_close(struct probe_session *s);
+const char *probe_strerror(int err);
+
+/*
+ * Per-phase tracing of the ping-pongs (trace.c), off unless trace_start()
+ * was called: trace_now() and trace_mark() then cost a single test.
+ */
+#define TRACE_RECORDS 65536	/* phases kept in the ring, about 1.5 MiB */
+enum trace_phase {
+	TRACE_PING,		/* a whole repetition, as seen by the client */
+	TRACE_SEND,		/* client: writing the request */
+	TRACE_WAIT,		/* until the first bytes of the answer (client) or request (server) */
+	TRACE_READ_REST,	/* client: the rest of a multi-segment answer */
+	TRACE_TIMEOUT,		/* client: waiting for a UDP answer that never came */
+	TRACE_READ,		/* server: the rest of the request */
+	TRACE_REPLY,		/* server: building and sending the answer */
+	TRACE_PHASES
+};
+extern int trace_on;
+void trace_start(const char *path, const char *name);
+void trace_test(int is_udp, int size);
+int64_t trace_add(int phase, int rep, int64_t start_ns, int64_t end_ns);
+#define trace_now() (trace_on ? now_ns() : 0)
+#define trace_mark(phase, rep, start_ns) (trace_on ? trace_add(phase, rep, start_ns, now_ns()) : 0)
+
+/* Performance counters around a measurement loop (perfcount.c) */
+#define PERF_MAXEVENTS 8
+struct perf_counters {
+	int fds[PERF_MAXEVENTS], n;	/* fds[0] leads the group */
+	const char *names[PERF_MAXEVENTS];
+	uint64_t values[PERF_MAXEVENTS];
+	int hardware;		/* 0: the PMU is missing, software events only */
+	int exclude_kernel;	/* perf_event_paranoid allows user space only */
+	int scaled;		/* the group was multiplexed, values are estimates */
+};
+
+int perf_open(struct perf_counters *pc);
+void perf_begin(struct perf_counters *pc);
+void perf_end(struct perf_counters *pc);
+void perf_close(struct perf_counters *pc);
+void print_perf_counters(FILE * outf, const char *name, const struct perf_counters *pc, int round_trips);
+
+/* TCP_INFO samples of a ping-pong test, see tcpinfo.c */
+#define CC_NAME_MAX 16		/* TCP_CA_NAME_MAX of the kernel */
+struct tcp_sample {
+	int rep;		/* taken after this repetition, 0 before the first */
+	uint32_t srtt_us, rttvar_us;
+	uint32_t cwnd;		/* segments */
+	uint32_t retrans;	/* total retransmissions of the connection */
+	uint64_t delivery_rate, pacing_rate;	/* bytes/s, 0 if not reported */
+};
+
+int tcp_sample_take(int sock, int rep, struct tcp_sample *s);
+int tcp_sample_due(int rep, int every, int norep);
+int tcp_sample_count(int every, int norep);
+int set_congestion(int sock, const char *algo);
+int get_congestion(int sock, char algo[CC_NAME_MAX]);
+int write_tcpinfo_report(int fd, const struct tcp_sample *samples, int n);
+int read_tcpinfo_report(int fd, struct tcp_sample *samples, int max_samples);
+void print_tcpinfo(FILE * outf, const char *name, const double rtt[], const struct tcp_sample *client, int n_client,
+		   const struct tcp_sample *server, int n_server);
+
+/* Messages of a replayed workload (--replay), see workload.c */
+struct workload {
+	int n;			/* messages, at most MAXREPEATS */
+	int max_size;		/* the largest message: buffers are sized for it */
+	int sizes[MAXREPEATS];
+	int64_t gaps_ns[MAXREPEATS];	/* send time after the previous message, 0 back to back */
+};
+
+void load_workload(const char *spec, int count, double gap_us, int max_size, struct workload *w);
+void workload_wait(int64_t *next_ns, int64_t gap_ns);
+void print_workload_report(FILE * outf, const char *name, const struct workload *w, const double rtt[]);
+
+/* AF_XDP fast path of the UDP pong (pong_server -x), see xdp_pong.c */
+int xdp_pong_start(const char *ifname, int queue, int generic);
+int xdp_pong_active(void);
+void xdp_pong_steer(int port, int last_seq);
+int xdp_pong_is_notice(const char *dgram, size_t len, const struct sockaddr_storage *from);
 
 ssize_t blocking_write_all(int fd, const void *buf, size_t count);
 
@@ -0,0 +1,632 @@
+/*
+ * pingpong_fanout.c: misura i RTT verso un elenco di pong_server (anche
+ *                    migliaia) da un solo processo: ogni thread gestisce
+ *                    con un ciclo di eventi epoll tutte le sue sessioni
+ *                    TCP e UDP, con socket non bloccanti, e distanzia gli
+ *                    invii in modo casuale perche' le sonde non si
+ *                    sincronizzino. I risultati sono riportati per server.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include "pingpong.h"
+
+#define MAXTHREADS 256
+#define MAXEVENTS 256
+#define ZERO_LEN 65536		/* message bytes after the sequence number, sent from here */
+
+enum fanout_state {
+	S_IDLE,			/* waiting for its start time */
+	S_CONNECT,
+	S_SEND,			/* flushing out_hdr and out_zeros, then next_state */
+	S_LINE,			/* reading the "OK" answer */
+	S_TCP_RESP,
+	S_UDP_RESP,
+	S_GAP,			/* waiting before the next ping */
+	S_DONE,
+	S_FAILED
+};
+
+/* One Pong server of the list: a small state machine driven by its loop */
+struct fanout_target {
+	const char *name;
+	int is_udp;
+	int idx;		/* in its loop, also the epoll data of its sockets */
+	struct sockaddr_in addr;
+	enum fanout_state state, next_state;
+	int tcp_fd, udp_fd;
+	char out_hdr[MAX_REQ];	/* pending output: a header... */
+	size_t out_hdr_len, out_zeros, out_done;	/* ...followed by out_zeros zero bytes */
+	char line[MAX_ANSW];
+	size_t line_len, resp_got;
+	int seq, resent, resent_total;
+	int64_t send_ns;
+	int64_t timer_ns;	/* deadline of the current state */
+	int heap_idx;		/* in the loop's timer heap, -1 if not there */
+	int n_rtt;
+	double *rtt_ms;
+	const char *error;	/* why it failed */
+	int error_errno;
+};
+
+struct fanout_config {
+	int msg_size, resp_size, count;
+	double gap_ms, jitter, ramp_ms;
+	int timeout_ms;
+	struct ping_options opts;
+};
+
+/* One event loop: its targets, their timers and a scratch buffer */
+struct fanout_loop {
+	pthread_t thread;
+	const struct fanout_config *cfg;
+	struct fanout_target **targets;
+	int n_targets, active;
+	struct fanout_target **heap;
+	int heap_len;
+	int epoll_fd;
+	unsigned short rand_state[3];
+	char scratch[ZERO_LEN];
+};
+
+static const char zeros[ZERO_LEN];
+
+/*** timer heap: the earliest deadline of the loop's targets on top ***/
+
+static void heap_swap(struct fanout_loop *l, int i, int j)
+{
+	struct fanout_target *t = l->heap[i];
+	l->heap[i] = l->heap[j];
+	l->heap[j] = t;
+	l->heap[i]->heap_idx = i;
+	l->heap[j]->heap_idx = j;
+}
+
+static void heap_fix(struct fanout_loop *l, int i)
+{
+	int child;
+	while (i > 0 && l->heap[(i - 1) / 2]->timer_ns > l->heap[i]->timer_ns) {
+		heap_swap(l, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	while ((child = 2 * i + 1) < l->heap_len) {
+		if (child + 1 < l->heap_len && l->heap[child + 1]->timer_ns < l->heap[child]->timer_ns)
+			child++;
+		if (l->heap[i]->timer_ns <= l->heap[child]->timer_ns)
+			break;
+		heap_swap(l, i, child);
+		i = child;
+	}
+}
+
+static void set_timer(struct fanout_loop *l, struct fanout_target *t, int64_t when)
+{
+	t->timer_ns = when;
+	if (t->heap_idx < 0) {
+		t->heap_idx = l->heap_len;
+		l->heap[l->heap_len++] = t;
+	}
+	heap_fix(l, t->heap_idx);
+}
+
+static void clear_timer(struct fanout_loop *l, struct fanout_target *t)
+{
+	const int i = t->heap_idx;
+	if (i < 0)
+		return;
+	t->heap_idx = -1;
+	if (i == --l->heap_len)
+		return;
+	l->heap[i] = l->heap[l->heap_len];
+	l->heap[i]->heap_idx = i;
+	heap_fix(l, i);
+}
+
+/*** the state machine ***/
+
+static void finish(struct fanout_loop *l, struct fanout_target *t, enum fanout_state state, const char *error)
+{
+	t->state = state;
+	t->error = error;
+	t->error_errno = error ? errno : 0;
+	clear_timer(l, t);
+	if (t->tcp_fd >= 0)
+		close(t->tcp_fd);	/* also leaves the epoll set */
+	if (t->udp_fd >= 0)
+		close(t->udp_fd);
+	t->tcp_fd = t->udp_fd = -1;
+	l->active--;
+}
+
+/* Edge-triggered: advance() always goes on until EAGAIN */
+static int add_fd(struct fanout_loop *l, int fd, const struct fanout_target *t)
+{
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	ev.data.u32 = (uint32_t)t->idx;
+	return epoll_ctl(l->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int64_t jittered_gap(struct fanout_loop *l)
+{
+	const struct fanout_config *cfg = l->cfg;
+	return (int64_t)(cfg->gap_ms * 1e6 * (1.0 + cfg->jitter * (2.0 * erand48(l->rand_state) - 1.0)));
+}
+
+static void start_connect(struct fanout_loop *l, struct fanout_target *t)
+{
+	const int nodelay_value = 1;
+	if ((t->tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)) < 0 ||
+	    setsockopt(t->tcp_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay_value, sizeof nodelay_value) ||
+	    add_fd(l, t->tcp_fd, t)) {
+		finish(l, t, S_FAILED, "cannot create socket");
+		return;
+	}
+	if (connect(t->tcp_fd, (struct sockaddr *)&t->addr, sizeof t->addr) && errno != EINPROGRESS) {
+		finish(l, t, S_FAILED, "connect");
+		return;
+	}
+	t->state = S_CONNECT;
+	set_timer(l, t, now_ns() + (int64_t)l->cfg->timeout_ms * 1000000);
+}
+
+/* Writes as much pending output as the socket takes: 1 when all is out,
+   0 to wait for EPOLLOUT, -1 on error */
+static int flush_output(struct fanout_target *t)
+{
+	const size_t total = t->out_hdr_len + t->out_zeros;
+	while (t->out_done < total) {
+		struct iovec iov[2];
+		int n_iov = 0;
+		ssize_t n;
+		if (t->out_done < t->out_hdr_len) {
+			iov[n_iov].iov_base = t->out_hdr + t->out_done;
+			iov[n_iov++].iov_len = t->out_hdr_len - t->out_done;
+		}
+		iov[n_iov].iov_base = (void *)zeros;
+		iov[n_iov].iov_len = total - t->out_done - (n_iov ? iov[0].iov_len : 0);
+		if (iov[n_iov].iov_len > ZERO_LEN)
+			iov[n_iov].iov_len = ZERO_LEN;
+		if (iov[n_iov].iov_len)
+			n_iov++;
+		if ((n = writev(t->tcp_fd, iov, n_iov)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		t->out_done += (size_t)n;
+	}
+	return 1;
+}
+
+static void send_ping(struct fanout_loop *l, struct fanout_target *t)
+{
+	const struct fanout_config *cfg = l->cfg;
+	t->out_hdr_len = (size_t)sprintf(t->out_hdr, "%d\n", ++t->seq);
+	t->out_zeros = (size_t)cfg->msg_size - t->out_hdr_len;
+	t->out_done = 0;
+	t->resent = 0;
+	t->send_ns = now_ns();
+	if (t->is_udp) {
+		struct iovec iov[2] = { { t->out_hdr, t->out_hdr_len }, { (void *)zeros, t->out_zeros } };
+		/* a datagram the socket cannot take now is simply resent after UDP_TIMEOUT */
+		writev(t->udp_fd, iov, 2);
+		t->state = S_UDP_RESP;
+		set_timer(l, t, t->send_ns + (int64_t)(UDP_TIMEOUT * 1e6));
+	} else {
+		t->resp_got = 0;
+		t->state = S_SEND;
+		t->next_state = S_TCP_RESP;
+		set_timer(l, t, t->send_ns + (int64_t)cfg->timeout_ms * 1000000);
+	}
+}
+
+static void got_rtt(struct fanout_loop *l, struct fanout_target *t)
+{
+	t->rtt_ms[t->n_rtt++] = (now_ns() - t->send_ns) / 1e6;
+	if (t->n_rtt == l->cfg->count) {
+		finish(l, t, S_DONE, NULL);
+		return;
+	}
+	t->state = S_GAP;
+	set_timer(l, t, now_ns() + jittered_gap(l));
+}
+
+/* The server agreed: for UDP, its answer carries the port to ping */
+static void got_ok(struct fanout_loop *l, struct fanout_target *t)
+{
+	int port;
+	if (t->is_udp) {
+		struct sockaddr_in udp_addr = t->addr;
+		if (sscanf(t->line, "OK %d", &port) != 1) {
+			errno = 0;
+			finish(l, t, S_FAILED, "request refused");
+			return;
+		}
+		udp_addr.sin_port = htons((uint16_t)port);
+		if ((t->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0 ||
+		    connect(t->udp_fd, (struct sockaddr *)&udp_addr, sizeof udp_addr) || add_fd(l, t->udp_fd, t)) {
+			finish(l, t, S_FAILED, "cannot create UDP socket");
+			return;
+		}
+	} else if (strncmp(t->line, "OK", 2) != 0) {
+		errno = 0;
+		finish(l, t, S_FAILED, "request refused");
+		return;
+	}
+	send_ping(l, t);
+}
+
+/*
+ * Takes t as far as its sockets allow without blocking: called for every
+ * epoll event of t, and again after each state change.
+ */
+static void advance(struct fanout_loop *l, struct fanout_target *t)
+{
+	const struct fanout_config *cfg = l->cfg;
+	struct sockaddr_in peer;
+	socklen_t err_len = sizeof(int), peer_len = sizeof peer;
+	ssize_t n;
+	int err, answer_seq;
+
+	for (;;)
+		switch (t->state) {
+		case S_CONNECT:
+			if (getsockopt(t->tcp_fd, SOL_SOCKET, SO_ERROR, &err, &err_len) || err) {
+				errno = err;
+				finish(l, t, S_FAILED, "connect");
+				return;
+			}
+			if (getpeername(t->tcp_fd, (struct sockaddr *)&peer, &peer_len))
+				return;	/* still in progress */
+			build_request(t->out_hdr, t->is_udp ? "UDP" : "TCP", cfg->msg_size, cfg->count, &cfg->opts);
+			t->out_hdr_len = strlen(t->out_hdr);
+			t->out_zeros = t->out_done = 0;
+			t->line_len = 0;
+			t->state = S_SEND;
+			t->next_state = S_LINE;
+			break;
+		case S_SEND:
+			if ((err = flush_output(t)) <= 0) {
+				if (err < 0)
+					finish(l, t, S_FAILED, "send");
+				return;
+			}
+			t->state = t->next_state;
+			break;
+		case S_LINE:
+			while ((n = read(t->tcp_fd, t->line + t->line_len, 1)) == 1)
+				if (t->line[t->line_len++] == '\n' || t->line_len == sizeof t->line - 1)
+					break;
+			if (n == 1) {
+				t->line[t->line_len] = 0;
+				got_ok(l, t);
+				if (t->state == S_FAILED)
+					return;
+				break;
+			}
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				return;
+			if (n == 0)
+				errno = ECONNRESET;
+			finish(l, t, S_FAILED, "no answer to the request");
+			return;
+		case S_TCP_RESP:
+			while (t->resp_got < (size_t)cfg->resp_size) {
+				size_t want = (size_t)cfg->resp_size - t->resp_got;
+				if ((n = read(t->tcp_fd, l->scratch, want < ZERO_LEN ? want : ZERO_LEN)) <= 0)
+					break;
+				t->resp_got += (size_t)n;
+			}
+			if (t->resp_got == (size_t)cfg->resp_size) {
+				got_rtt(l, t);
+				break;
+			}
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				return;
+			if (n == 0)
+				errno = ECONNRESET;
+			finish(l, t, S_FAILED, "receive");
+			return;
+		case S_UDP_RESP:
+			while ((n = recv(t->udp_fd, l->scratch, ZERO_LEN, 0)) >= 0)
+				if (n == cfg->resp_size && sscanf(l->scratch, "%d\n", &answer_seq) == 1 && answer_seq == t->seq)
+					break;	/* late answers to earlier pings are skipped */
+			if (n >= 0) {
+				got_rtt(l, t);
+				break;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return;
+			finish(l, t, S_FAILED, "receive");
+			return;
+		default:	/* S_IDLE and S_GAP wait for their timer */
+			return;
+		}
+}
+
+static void on_timer(struct fanout_loop *l, struct fanout_target *t)
+{
+	switch (t->state) {
+	case S_IDLE:
+		start_connect(l, t);
+		return;
+	case S_GAP:
+		send_ping(l, t);
+		advance(l, t);
+		return;
+	case S_UDP_RESP:
+		if (t->resent < MAXUDPRESEND) {
+			struct iovec iov[2] = { { t->out_hdr, t->out_hdr_len }, { (void *)zeros, t->out_zeros } };
+			t->resent++;
+			t->resent_total++;
+			t->send_ns = now_ns();
+			writev(t->udp_fd, iov, 2);
+			set_timer(l, t, t->send_ns + (int64_t)(UDP_TIMEOUT * 1e6));
+			return;
+		}
+		/* fall through */
+	default:
+		errno = ETIMEDOUT;
+		finish(l, t, S_FAILED, "timeout");
+	}
+}
+
+static void *fanout_loop_run(void *arg)
+{
+	struct fanout_loop *l = arg;
+	struct epoll_event events[MAXEVENTS];
+	const int64_t start = now_ns();
+	int i, n, timeout;
+
+	for (i = 0; i < l->n_targets; i++)	/* staggered starts */
+		set_timer(l, l->targets[i], start + (int64_t)(l->cfg->ramp_ms * 1e6 * erand48(l->rand_state)));
+	while (l->active > 0) {
+		timeout = -1;
+		if (l->heap_len) {
+			const int64_t wait_ns = l->heap[0]->timer_ns - now_ns();
+			timeout = wait_ns <= 0 ? 0 : (int)((wait_ns + 999999) / 1000000);
+		}
+		if ((n = epoll_wait(l->epoll_fd, events, MAXEVENTS, timeout)) < 0 && errno != EINTR)
+			fail_errno("Fan-out epoll_wait failed");
+		for (i = 0; i < n; i++) {
+			struct fanout_target *t = l->targets[events[i].data.u32];
+			if (t->state != S_DONE && t->state != S_FAILED)	/* finished earlier in this batch */
+				advance(l, t);
+		}
+		while (l->heap_len && l->heap[0]->timer_ns <= now_ns()) {
+			struct fanout_target *t = l->heap[0];
+			clear_timer(l, t);
+			on_timer(l, t);
+		}
+	}
+	close(l->epoll_fd);
+	return NULL;
+}
+
+/* Reads "[tcp:|udp:]HOST:PORT" lines ('#' starts a comment) */
+static struct fanout_target *read_targets(const char *path, int *n_targets)
+{
+	FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	struct fanout_target *targets = NULL;
+	struct addrinfo gai_hints, *addr;
+	char *line = NULL, *name, *host, *port;
+	size_t line_cap = 0;
+	int n = 0, cap = 0, lineno = 0;
+
+	if (f == NULL)
+		fail_errno(path);
+	memset(&gai_hints, 0, sizeof gai_hints);
+	gai_hints.ai_family = AF_INET;
+	while (getline(&line, &line_cap, f) >= 0) {
+		struct fanout_target *t;
+		lineno++;
+		if ((name = strtok(line, " \t\n")) == NULL || *name == '#')
+			continue;
+		if (n == cap) {
+			cap = cap ? 2 * cap : 256;
+			if ((targets = realloc(targets, (size_t)cap * sizeof *targets)) == NULL)
+				fail_errno("Fan-out cannot allocate the target list");
+		}
+		t = &targets[n];
+		memset(t, 0, sizeof *t);
+		if ((t->name = strdup(name)) == NULL)
+			fail_errno("Fan-out cannot allocate the target list");
+		host = name;
+		if (strncmp(host, "udp:", 4) == 0 || strncmp(host, "tcp:", 4) == 0) {
+			t->is_udp = host[0] == 'u';
+			host += 4;
+		}
+		if ((port = strrchr(host, ':')) == NULL || port == host) {
+			fprintf(stderr, "Fan-out: line %d: targets are [tcp:|udp:]HOST:PORT\n", lineno);
+			exit(EXIT_FAILURE);
+		}
+		*port++ = 0;
+		if (getaddrinfo(host, port, &gai_hints, &addr)) {
+			fprintf(stderr, "Fan-out: line %d: cannot resolve %s\n", lineno, t->name);
+			exit(EXIT_FAILURE);
+		}
+		memcpy(&t->addr, addr->ai_addr, sizeof t->addr);
+		freeaddrinfo(addr);
+		t->tcp_fd = t->udp_fd = t->heap_idx = -1;
+		n++;
+	}
+	free(line);
+	if (f != stdin)
+		fclose(f);
+	*n_targets = n;
+	return targets;
+}
+
+static void print_target(const struct fanout_target *t, int count)
+{
+	double *v = t->rtt_ms;
+	const int n = t->n_rtt;
+	if (n)
+		qsort(v, (size_t)n, sizeof(double), double_cmp);
+	if (t->state == S_DONE)
+		printf("%-32s ok=%d resent=%d min=%.4lf p50=%.4lf p90=%.4lf p99=%.4lf max=%.4lf\n", t->name, n,
+		       t->resent_total, v[0], v[(50 * n) / 100], v[(90 * n) / 100], v[(99 * n) / 100], v[n - 1]);
+	else
+		printf("%-32s FAILED after %d of %d pings: %s%s%s\n", t->name, n, count, t->error,
+		       t->error_errno ? ": " : "", t->error_errno ? strerror(t->error_errno) : "");
+}
+
+int main(int argc, char **argv)
+{
+	static const char *const usage =
+	    "Fan-out incorrect syntax. Use: pingpong_fanout [-n COUNT] [-s SIZE] [-r RESP_SIZE] [-g GAP_MS] [-J JITTER%]"
+	    " [-R RAMP_MS] [-t TIMEOUT_MS] [-j THREADS] TARGET_FILE|-";
+	static const struct option long_options[] = {
+		{ "count", required_argument, NULL, 'n' },
+		{ "size", required_argument, NULL, 's' },
+		{ "response", required_argument, NULL, 'r' },
+		{ "gap", required_argument, NULL, 'g' },
+		{ "jitter", required_argument, NULL, 'J' },
+		{ "ramp", required_argument, NULL, 'R' },
+		{ "timeout", required_argument, NULL, 't' },
+		{ "threads", required_argument, NULL, 'j' },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct fanout_config cfg;
+	struct fanout_target *targets;
+	struct fanout_loop *loops;
+	struct rlimit nofile;
+	struct rusage ru;
+	long n_threads = 1;
+	int n_targets, opt, i, done = 0, pings = 0;
+	int64_t start, elapsed;
+
+	memset(&cfg, 0, sizeof cfg);
+	cfg.msg_size = 64;
+	cfg.count = 20;
+	cfg.gap_ms = 100.0;
+	cfg.jitter = 0.5;
+	cfg.ramp_ms = -1.0;
+	cfg.timeout_ms = 2000;
+	while ((opt = getopt_long(argc, argv, "n:s:r:g:J:R:t:j:", long_options, NULL)) != -1)
+		switch (opt) {
+		case 'n':
+			cfg.count = atoi(optarg);
+			break;
+		case 's':
+			cfg.msg_size = atoi(optarg);
+			break;
+		case 'r':
+			cfg.opts.resp_size = atoi(optarg);
+			break;
+		case 'g':
+			cfg.gap_ms = atof(optarg);
+			break;
+		case 'J':
+			cfg.jitter = atof(optarg) / 100.0;
+			break;
+		case 'R':
+			cfg.ramp_ms = atof(optarg);
+			break;
+		case 't':
+			cfg.timeout_ms = atoi(optarg);
+			break;
+		case 'j':
+			n_threads = atol(optarg);
+			break;
+		default:
+			fail(usage);
+		}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc != 2)
+		fail(usage);
+	cfg.resp_size = response_size(cfg.msg_size, &cfg.opts);
+	/* one size limit for the TCP and UDP targets of a list */
+	if (cfg.count < 1 || cfg.count > MAXREPEATS || cfg.msg_size < MINSIZE || cfg.msg_size > MAXUDPSIZE ||
+	    cfg.resp_size < MINSIZE || cfg.resp_size > MAXUDPSIZE)
+		fail("Fan-out: incorrect count, message or response size");
+	/* the server gives up on a test silent for PONGRECVTOUT seconds */
+	if (cfg.gap_ms < 0.0 || cfg.gap_ms * (1.0 + cfg.jitter) >= PONGRECVTOUT * 1000 / 2 || cfg.jitter < 0.0 ||
+	    cfg.jitter > 1.0 || cfg.timeout_ms < 1)
+		fail("Fan-out: incorrect gap, jitter or timeout");
+	if (cfg.ramp_ms < 0.0)
+		cfg.ramp_ms = cfg.gap_ms;
+	if (n_threads < 1)
+		n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_threads > MAXTHREADS)
+		n_threads = MAXTHREADS;
+
+	targets = read_targets(argv[1], &n_targets);
+	if (n_targets == 0)
+		fail("Fan-out: no targets");
+	if (n_threads > n_targets)
+		n_threads = n_targets;
+	/* two descriptors per UDP target */
+	if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max) {
+		nofile.rlim_cur = nofile.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &nofile);
+	}
+
+	if ((loops = calloc((size_t)n_threads, sizeof *loops)) == NULL)
+		fail_errno("Fan-out cannot allocate its event loops");
+	for (i = 0; i < n_targets; i++)
+		if ((targets[i].rtt_ms = malloc((size_t)cfg.count * sizeof(double))) == NULL)
+			fail_errno("Fan-out cannot allocate the results");
+	for (i = 0; i < n_threads; i++) {
+		struct fanout_loop *l = &loops[i];
+		int j;
+		l->cfg = &cfg;
+		l->targets = malloc((size_t)(n_targets / n_threads + 1) * sizeof *l->targets);
+		l->heap = malloc((size_t)(n_targets / n_threads + 1) * sizeof *l->heap);
+		if (l->targets == NULL || l->heap == NULL || (l->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+			fail_errno("Fan-out cannot create an event loop");
+		for (j = i; j < n_targets; j += (int)n_threads) {	/* round robin */
+			targets[j].idx = l->n_targets;
+			l->targets[l->n_targets++] = &targets[j];
+		}
+		l->active = l->n_targets;
+		l->rand_state[0] = 0x330e;
+		l->rand_state[1] = (unsigned short)i;
+		l->rand_state[2] = (unsigned short)getpid();
+	}
+
+	signal(SIGPIPE, SIG_IGN);	/* a server gone away is a failed target */
+	start = now_ns();
+	for (i = 0; i < n_threads; i++)
+		if ((errno = pthread_create(&loops[i].thread, NULL, fanout_loop_run, &loops[i])))
+			fail_errno("Fan-out cannot start a thread");
+	for (i = 0; i < n_threads; i++)
+		if ((errno = pthread_join(loops[i].thread, NULL)))
+			fail_errno("Fan-out cannot join a thread");
+	elapsed = now_ns() - start;
+
+	for (i = 0; i < n_targets; i++) {
+		print_target(&targets[i], cfg.count);
+		done += targets[i].state == S_DONE;
+		pings += targets[i].n_rtt;
+	}
+	if (getrusage(RUSAGE_SELF, &ru))
+		fail_errno("Fan-out cannot get resource usage");
+	printf("\nFan-out: %d of %d targets completed, %d pings in %lg s (%lg pings/s) with %ld event loops,"
+	       " CPU %lg s\n", done, n_targets, pings, elapsed / 1e9, pings / (elapsed / 1e9), n_threads,
+	       ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6);
+	return done == n_targets ? EXIT_SUCCESS : EXIT_FAILURE;
+}
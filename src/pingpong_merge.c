@@ -0,0 +1,242 @@
+/*
+ * pingpong_merge.c: combina gli sketch dei RTT scritti da tcp_ping e
+ *                   udp_ping (opzione -k) da un numero qualsiasi di host e
+ *                   di esecuzioni, e riporta i percentili complessivi per
+ *                   protocollo e dimensione dei messaggi, oltre ai file
+ *                   <protocollo>_throughput.dat usati da gplot.bash.
+ *                   I file vengono letti in parallelo da piu` thread; la
+ *                   memoria usata non dipende dal numero di campioni.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include "pingpong.h"
+
+#define MAXTHREADS 256
+
+/* Everything merged so far for one protocol, message and response size */
+struct merged_sketch {
+	char protocol[SKETCH_PROTO_LEN];
+	int msg_size, resp_size;
+	unsigned long long sketches;
+	struct latency_hist hist;
+};
+
+/* A set of merged sketches: one per worker thread, then the final one */
+struct sketch_table {
+	struct merged_sketch **entries;
+	int n, cap;
+	unsigned long long files, sketches, malformed;
+};
+
+struct merge_job {
+	char **paths;
+	int n_paths;
+	int next;		/* next path to take, shared by the workers */
+	pthread_mutex_t lock;
+};
+
+static struct merged_sketch *table_entry(struct sketch_table *t, const char *protocol, int msg_size, int resp_size)
+{
+	struct merged_sketch *m;
+	int i;
+	for (i = 0; i < t->n; i++) {
+		m = t->entries[i];
+		if (m->msg_size == msg_size && m->resp_size == resp_size && strcmp(m->protocol, protocol) == 0)
+			return m;
+	}
+	if (t->n == t->cap) {
+		t->cap = t->cap ? 2 * t->cap : 16;
+		if ((t->entries = realloc(t->entries, (size_t)t->cap * sizeof *t->entries)) == NULL)
+			fail_errno("Merge cannot allocate the sketch table");
+	}
+	if ((m = malloc(sizeof *m)) == NULL)
+		fail_errno("Merge cannot allocate a sketch");
+	strcpy(m->protocol, protocol);
+	m->msg_size = msg_size;
+	m->resp_size = resp_size;
+	m->sketches = 0;
+	hist_init(&m->hist);
+	t->entries[t->n++] = m;
+	return m;
+}
+
+static void merge_file(struct sketch_table *t, const char *path, struct latency_hist *scratch)
+{
+	char protocol[SKETCH_PROTO_LEN];
+	int msg_size, resp_size, rv;
+	struct merged_sketch *m;
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL) {
+		fprintf(stderr, "pingpong_merge: cannot open %s: %s\n", path, strerror(errno));
+		t->malformed++;
+		return;
+	}
+	while ((rv = hist_read(f, protocol, &msg_size, &resp_size, scratch)) == 1) {
+		m = table_entry(t, protocol, msg_size, resp_size);
+		hist_merge(&m->hist, scratch);
+		m->sketches++;
+		t->sketches++;
+	}
+	if (rv < 0) {		/* the rest of the file cannot be trusted */
+		fprintf(stderr, "pingpong_merge: malformed sketch in %s, rest of the file skipped\n", path);
+		t->malformed++;
+	}
+	t->files++;
+	fclose(f);
+}
+
+static void *merge_worker(void *arg)
+{
+	struct merge_job *job = arg;
+	struct sketch_table *t = calloc(1, sizeof *t);
+	struct latency_hist *scratch = malloc(sizeof *scratch);
+	int i;
+
+	if (t == NULL || scratch == NULL)
+		fail_errno("Merge cannot allocate worker state");
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+		if (i >= job->n_paths)
+			break;
+		merge_file(t, job->paths[i], scratch);
+	}
+	free(scratch);
+	return t;
+}
+
+static int merged_cmp(const void *p1, const void *p2)
+{
+	const struct merged_sketch *m1 = *(struct merged_sketch *const *)p1, *m2 = *(struct merged_sketch *const *)p2;
+	int c = strcmp(m1->protocol, m2->protocol);
+	if (c)
+		return c;
+	if (m1->msg_size != m2->msg_size)
+		return m1->msg_size < m2->msg_size ? -1 : 1;
+	return m1->resp_size < m2->resp_size ? -1 : m1->resp_size > m2->resp_size;
+}
+
+/* Same columns as collect_throughput.bash: size, median and average
+   throughput (KB/s) of requests and responses together; only symmetric
+   tests (no -r), so that the plots get one point per size */
+static void write_throughput(const struct sketch_table *t, const char *dir, const char *protocol)
+{
+	char path[4096];
+	FILE *f = NULL;
+	int i;
+	for (i = 0; i < t->n; i++) {
+		const struct merged_sketch *m = t->entries[i];
+		const double bytes = m->msg_size + m->resp_size;
+		if (strcmp(m->protocol, protocol) || m->resp_size != m->msg_size || m->hist.count == 0)
+			continue;
+		if (f == NULL) {
+			snprintf(path, sizeof path, "%s/%s_throughput.dat", dir, protocol);
+			if ((f = fopen(path, "w")) == NULL)
+				fail_errno(path);
+		}
+		fprintf(f, "%d %lg %lg\n", m->msg_size, bytes / (hist_percentile(&m->hist, 50) / 1e6),
+			bytes / (m->hist.sum_ns / (double)m->hist.count / 1e6));
+	}
+	if (f && fclose(f))
+		fail_errno("Merge cannot write the throughput file");
+}
+
+int main(int argc, char **argv)
+{
+	static const char *const usage = "Merge incorrect syntax. Use: pingpong_merge [-j THREADS] [-o DIR] SKETCH_FILE...";
+	struct merge_job job;
+	struct sketch_table total;
+	pthread_t threads[MAXTHREADS];
+	long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *out_dir = ".";
+	int opt, i, j;
+
+	while ((opt = getopt(argc, argv, "j:o:")) != -1)
+		switch (opt) {
+		case 'j':
+			n_threads = atol(optarg);
+			break;
+		case 'o':
+			out_dir = optarg;
+			break;
+		default:
+			fail(usage);
+		}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc < 2)
+		fail(usage);
+	if (n_threads < 1)
+		n_threads = 1;
+	if (n_threads > MAXTHREADS)
+		n_threads = MAXTHREADS;
+	if (n_threads > argc - 1)
+		n_threads = argc - 1;
+
+	job.paths = argv + 1;
+	job.n_paths = argc - 1;
+	job.next = 0;
+	if (pthread_mutex_init(&job.lock, NULL))
+		fail("Merge cannot initialize a mutex");
+	for (i = 0; i < n_threads; i++)
+		if ((errno = pthread_create(&threads[i], NULL, merge_worker, &job)))
+			fail_errno("Merge cannot start a thread");
+
+	/*** every worker has its own table: merge them once they are done ***/
+	memset(&total, 0, sizeof total);
+	for (i = 0; i < n_threads; i++) {
+		struct sketch_table *t;
+		if ((errno = pthread_join(threads[i], (void **)&t)))
+			fail_errno("Merge cannot join a thread");
+		for (j = 0; j < t->n; j++) {
+			struct merged_sketch *m = t->entries[j];
+			struct merged_sketch *dst = table_entry(&total, m->protocol, m->msg_size, m->resp_size);
+			hist_merge(&dst->hist, &m->hist);
+			dst->sketches += m->sketches;
+			free(m);
+		}
+		total.files += t->files;
+		total.sketches += t->sketches;
+		total.malformed += t->malformed;
+		free(t->entries);
+		free(t);
+	}
+	qsort(total.entries, (size_t)total.n, sizeof *total.entries, merged_cmp);
+
+	printf("Merged %llu sketches from %llu files with %ld threads (%llu files with errors)\n",
+	       total.sketches, total.files, n_threads, total.malformed);
+	for (i = 0; i < total.n; i++) {
+		const struct merged_sketch *m = total.entries[i];
+		if (m->resp_size == m->msg_size)
+			printf("\n%s %d byte messages: %llu samples from %llu sketches\n", m->protocol, m->msg_size,
+			       (unsigned long long)m->hist.count, m->sketches);
+		else
+			printf("\n%s %d byte messages with %d byte responses: %llu samples from %llu sketches\n", m->protocol,
+			       m->msg_size, m->resp_size, (unsigned long long)m->hist.count, m->sketches);
+		print_hist_percentiles(stdout, "  RTT (ms)", &m->hist);
+		printf("  percentile 99.9: %lg, percentile 99.99: %lg\n",
+		       hist_percentile(&m->hist, 99.9) / 1e6, hist_percentile(&m->hist, 99.99) / 1e6);
+	}
+	write_throughput(&total, out_dir, "tcp");
+	write_throughput(&total, out_dir, "udp");
+	return total.malformed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
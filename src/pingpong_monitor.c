@@ -0,0 +1,401 @@
+/*
+ * pingpong_monitor.c: demone per il monitoraggio continuo di uno o piu`
+ *                     pong_server: tiene aperte le sessioni di controllo,
+ *                     esegue un ping-pong a bassa frequenza (con jitter)
+ *                     verso ciascun server, mantiene i percentili dei RTT
+ *                     su una finestra scorrevole in memoria costante e a
+ *                     ogni intervallo scrive un riepilogo compatto su file,
+ *                     su stdout o in un datagramma UDP, insieme al proprio
+ *                     consumo di CPU e memoria.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include "pingpong.h"
+
+#define MAXTARGETS 64
+#define MAXWINDOWS 360		/* report intervals in a sliding window */
+#define REPORT_LEN 512
+
+/* One monitored Pong server */
+struct target {
+	const char *name;	/* as given on the command line */
+	char host[256], port[16];
+	int is_udp;
+	struct probe_session *session;
+	int64_t next_ping_ns;
+	unsigned long long sent, errors, reconnects;	/* this interval */
+	int last_error, last_errno;
+	int opened_before;
+	struct latency_hist *windows;	/* ring of per-interval histograms */
+	int current;		/* slot of the interval in progress */
+	int filled;		/* slots in the window, the current one included */
+};
+
+struct monitor_options {
+	double period_ns;	/* between two pings of a target */
+	double jitter;		/* fraction of the period */
+	int64_t interval_ns;	/* between two reports */
+	int n_windows;		/* intervals in the sliding window */
+	int msg_size;
+	int timeout_ms;
+	struct ping_options ping;
+};
+
+static volatile sig_atomic_t stop_requested, reopen_requested;
+
+static void stop_handler(int signum)
+{
+	stop_requested = 1;
+}
+
+static void reopen_handler(int signum)
+{
+	reopen_requested = 1;
+}
+
+/* [tcp:|udp:]HOST:PORT */
+static void parse_target(struct target *t, const char *arg)
+{
+	const char *colon;
+	size_t len;
+
+	memset(t, 0, sizeof *t);
+	t->name = arg;
+	if (strncmp(arg, "udp:", 4) == 0) {
+		t->is_udp = 1;
+		arg += 4;
+	} else if (strncmp(arg, "tcp:", 4) == 0)
+		arg += 4;
+	if ((colon = strrchr(arg, ':')) == NULL || colon == arg || (len = (size_t)(colon - arg)) >= sizeof t->host ||
+	    strlen(colon + 1) == 0 || strlen(colon + 1) >= sizeof t->port)
+		fail("Monitor: targets are [tcp:|udp:]HOST:PORT");
+	memcpy(t->host, arg, len);
+	t->host[len] = 0;
+	strcpy(t->port, colon + 1);
+}
+
+/* Next ping time: one period later, give or take the jitter, so that the
+   pings of many monitors do not fall into step */
+static int64_t next_ping(const struct monitor_options *mo, int64_t from, unsigned short rand_state[3])
+{
+	return from + (int64_t)(mo->period_ns * (1.0 + mo->jitter * (2.0 * erand48(rand_state) - 1.0)));
+}
+
+static void ping_target(struct target *t, const struct monitor_options *mo)
+{
+	double rtt_ms;
+	int rv;
+
+	t->sent++;
+	if (t->session == NULL) {
+		if ((rv = probe_open(&t->session, t->host, t->port, mo->timeout_ms)) != PROBE_OK) {
+			t->errors++;
+			t->last_error = rv;
+			t->last_errno = errno;
+			return;
+		}
+		t->reconnects += t->opened_before;
+		t->opened_before = 1;
+	}
+	if ((rv = probe_ping(t->session, t->is_udp, mo->msg_size, &mo->ping, &rtt_ms)) != PROBE_OK) {
+		t->errors++;
+		t->last_error = rv;
+		t->last_errno = errno;
+		if (rv != PROBE_EREFUSED) {	/* reconnect at the next ping */
+			probe_close(t->session);
+			t->session = NULL;
+		}
+		return;
+	}
+	hist_add(&t->windows[t->current], (int64_t)(rtt_ms * 1e6));
+}
+
+static void emit(const char *line, FILE *out, int report_socket)
+{
+	if (report_socket >= 0)
+		send(report_socket, line, strlen(line), 0);	/* best effort, like syslog */
+	else {
+		fputs(line, out);
+		fflush(out);
+	}
+}
+
+/*
+ * One "key=value" line per target: the interval's counts and percentiles,
+ * then those of the sliding window (the last n_windows intervals). All
+ * times are in ms.
+ */
+static void report_target(struct target *t, const struct monitor_options *mo, const char *stamp, double interval_s,
+			  struct latency_hist *merged, FILE *out, int report_socket)
+{
+	const struct latency_hist *h = &t->windows[t->current];
+	char line[REPORT_LEN];
+	int i, len;
+
+	hist_init(merged);
+	for (i = 0; i < t->filled; i++)
+		hist_merge(merged, &t->windows[(t->current - i + mo->n_windows) % mo->n_windows]);
+	len = snprintf(line, sizeof line, "%s %s interval=%lg sent=%llu ok=%llu err=%llu", stamp, t->name, interval_s,
+		       t->sent, (unsigned long long)h->count, t->errors);
+	if (t->errors)
+		len += snprintf(line + len, sizeof line - (size_t)len, " last_err=\"%s\"", t->last_error == PROBE_ESYS ?
+				strerror(t->last_errno) : probe_strerror(t->last_error));
+	if (t->reconnects)
+		len += snprintf(line + len, sizeof line - (size_t)len, " reconnects=%llu", t->reconnects);
+	if (h->count)
+		len += snprintf(line + len, sizeof line - (size_t)len, " p50=%.4lf p99=%.4lf max=%.4lf",
+				hist_percentile(h, 50) / 1e6, hist_percentile(h, 99) / 1e6, h->max_ns / 1e6);
+	len += snprintf(line + len, sizeof line - (size_t)len, " window=%lg n=%llu", mo->interval_ns / 1e9 * t->filled,
+			(unsigned long long)merged->count);
+	if (merged->count)
+		snprintf(line + len, sizeof line - (size_t)len, " wp50=%.4lf wp90=%.4lf wp99=%.4lf wp999=%.4lf wmax=%.4lf\n",
+			 hist_percentile(merged, 50) / 1e6, hist_percentile(merged, 90) / 1e6,
+			 hist_percentile(merged, 99) / 1e6, hist_percentile(merged, 99.9) / 1e6, merged->max_ns / 1e6);
+	else
+		snprintf(line + len, sizeof line - (size_t)len, "\n");
+	emit(line, out, report_socket);
+
+	/*** the oldest interval leaves the window ***/
+	t->sent = t->errors = t->reconnects = 0;
+	t->current = (t->current + 1) % mo->n_windows;
+	hist_init(&t->windows[t->current]);
+	if (t->filled < mo->n_windows)
+		t->filled++;
+}
+
+static int64_t cpu_ns(const struct rusage *ru)
+{
+	return (int64_t)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000000 +
+	       (int64_t)(ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) * 1000;
+}
+
+static FILE *open_output(const char *path)
+{
+	FILE *f = fopen(path, "a");
+	if (f == NULL)
+		fail_errno(path);
+	return f;
+}
+
+static int open_report_socket(const char *arg)
+{
+	struct addrinfo gai_hints, *addr;
+	char host[256];
+	const char *colon = strrchr(arg, ':');
+	int sock;
+
+	if (colon == NULL || colon == arg || (size_t)(colon - arg) >= sizeof host)
+		fail("Monitor: the report socket is HOST:PORT");
+	memcpy(host, arg, (size_t)(colon - arg));
+	host[colon - arg] = 0;
+	memset(&gai_hints, 0, sizeof gai_hints);
+	gai_hints.ai_family = AF_INET;
+	gai_hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(host, colon + 1, &gai_hints, &addr))
+		fail("Monitor: cannot resolve the report socket address");
+	if ((sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0 ||
+	    connect(sock, addr->ai_addr, addr->ai_addrlen))
+		fail_errno("Monitor: cannot open the report socket");
+	freeaddrinfo(addr);
+	return sock;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *const usage =
+	    "Monitor incorrect syntax. Use: pingpong_monitor [-r PINGS/S] [-j JITTER%] [-i INTERVAL_S] [-w WINDOW_S]"
+	    " [-s SIZE] [-R RESP_SIZE] [-t TIMEOUT_MS] [-o FILE | -S HOST:PORT] [-D] [tcp:|udp:]HOST:PORT...";
+	static const struct option long_options[] = {
+		{ "rate", required_argument, NULL, 'r' },
+		{ "jitter", required_argument, NULL, 'j' },
+		{ "interval", required_argument, NULL, 'i' },
+		{ "window", required_argument, NULL, 'w' },
+		{ "size", required_argument, NULL, 's' },
+		{ "response", required_argument, NULL, 'R' },
+		{ "timeout", required_argument, NULL, 't' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "socket", required_argument, NULL, 'S' },
+		{ "detach", no_argument, NULL, 'D' },
+		{ NULL, 0, NULL, 0 }
+	};
+	static struct target targets[MAXTARGETS];
+	struct monitor_options mo;
+	struct latency_hist *merged;
+	struct sigaction action;
+	struct rusage ru_prev, ru;
+	unsigned short rand_state[3];
+	double rate = 1.0, interval_s = 10.0, window_s = 60.0;
+	const char *output_path = NULL, *socket_arg = NULL;
+	FILE *out = stdout;
+	int n_targets, report_socket = -1, detach = 0, opt, i;
+	int64_t start, now, wake, next_report, last_report;
+
+	memset(&mo, 0, sizeof mo);
+	mo.jitter = 0.1;
+	mo.msg_size = 64;
+	mo.timeout_ms = 1000;
+	while ((opt = getopt_long(argc, argv, "r:j:i:w:s:R:t:o:S:D", long_options, NULL)) != -1)
+		switch (opt) {
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'j':
+			mo.jitter = atof(optarg) / 100.0;
+			break;
+		case 'i':
+			interval_s = atof(optarg);
+			break;
+		case 'w':
+			window_s = atof(optarg);
+			break;
+		case 's':
+			mo.msg_size = atoi(optarg);
+			break;
+		case 'R':
+			mo.ping.resp_size = atoi(optarg);
+			break;
+		case 't':
+			mo.timeout_ms = atoi(optarg);
+			break;
+		case 'o':
+			output_path = optarg;
+			break;
+		case 'S':
+			socket_arg = optarg;
+			break;
+		case 'D':
+			detach = 1;
+			break;
+		default:
+			fail(usage);
+		}
+	argc -= optind - 1;
+	argv += optind - 1;
+	n_targets = argc - 1;
+	if (n_targets < 1 || n_targets > MAXTARGETS || (output_path && socket_arg) || (detach && !output_path && !socket_arg))
+		fail(usage);
+	/* an idle control session is closed by the server after PONGSESSIONTOUT */
+	if (rate <= 0.0 || 1.0 / rate > PONGSESSIONTOUT / 2 || mo.jitter < 0.0 || mo.jitter >= 1.0)
+		fail("Monitor: the rate must be above 1 ping every 150 s, the jitter below 100%");
+	if (interval_s <= 0.0 || window_s < interval_s || window_s / interval_s > MAXWINDOWS ||
+	    fabs(window_s / interval_s - floor(window_s / interval_s + 0.5)) > 1e-9)
+		fail("Monitor: the window must be a multiple of the interval, at most 360 intervals");
+	if (mo.msg_size < MINSIZE || mo.timeout_ms < 1)
+		fail("Monitor: incorrect message size or timeout");
+	mo.period_ns = 1e9 / rate;
+	mo.interval_ns = (int64_t)(interval_s * 1e9);
+	mo.n_windows = (int)(window_s / interval_s + 0.5);
+
+	for (i = 0; i < n_targets; i++) {
+		parse_target(&targets[i], argv[i + 1]);
+		if ((targets[i].windows = malloc((size_t)mo.n_windows * sizeof(struct latency_hist))) == NULL)
+			fail_errno("Monitor cannot allocate the sliding windows");
+		hist_init(&targets[i].windows[0]);
+		targets[i].filled = 1;
+	}
+	if ((merged = malloc(sizeof *merged)) == NULL)
+		fail_errno("Monitor cannot allocate the sliding windows");
+	if (output_path)
+		out = open_output(output_path);
+	if (socket_arg)
+		report_socket = open_report_socket(socket_arg);
+	if (detach && daemon(1, 0))
+		fail_errno("Monitor cannot detach");
+
+	memset(&action, 0, sizeof action);
+	action.sa_handler = stop_handler;	/* no SA_RESTART: the sleep must end */
+	sigaction(SIGTERM, &action, NULL);
+	sigaction(SIGINT, &action, NULL);
+	action.sa_handler = reopen_handler;	/* log rotation */
+	sigaction(SIGHUP, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	rand_state[0] = 0x330e;
+	rand_state[1] = (unsigned short)getpid();
+	rand_state[2] = (unsigned short)time(NULL);
+	start = last_report = now_ns();
+	next_report = start + mo.interval_ns;
+	for (i = 0; i < n_targets; i++)	/* spread the first pings over a period */
+		targets[i].next_ping_ns = start + (int64_t)(mo.period_ns * erand48(rand_state));
+	if (getrusage(RUSAGE_SELF, &ru_prev))
+		fail_errno("Monitor cannot get resource usage");
+
+	while (!stop_requested) {
+		wake = next_report;
+		for (i = 0; i < n_targets; i++)
+			if (targets[i].next_ping_ns < wake)
+				wake = targets[i].next_ping_ns;
+		if (wake > now_ns()) {
+			struct timespec ts = { (time_t)(wake / 1000000000), (long)(wake % 1000000000) };
+			clock_nanosleep(CLOCK_TYPE, TIMER_ABSTIME, &ts, NULL);
+			continue;	/* woken up early by a signal, or on time: look again */
+		}
+		if (reopen_requested && output_path) {
+			reopen_requested = 0;
+			fclose(out);
+			out = open_output(output_path);
+		}
+		now = now_ns();
+		for (i = 0; i < n_targets; i++) {
+			struct target *t = &targets[i];
+			if (t->next_ping_ns > now)
+				continue;
+			ping_target(t, &mo);
+			t->next_ping_ns = next_ping(&mo, t->next_ping_ns, rand_state);
+			now = now_ns();
+			if (t->next_ping_ns < now)	/* a timeout made us late: do not burst */
+				t->next_ping_ns = next_ping(&mo, now, rand_state);
+		}
+		if ((now = now_ns()) >= next_report) {
+			char stamp[32], line[REPORT_LEN];
+			time_t wall = time(NULL);
+			struct tm tm;
+			const int64_t report_start = now;
+			strftime(stamp, sizeof stamp, "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&wall, &tm));
+			for (i = 0; i < n_targets; i++)
+				report_target(&targets[i], &mo, stamp, (now - last_report) / 1e9, merged, out, report_socket);
+			/*** the monitor's own cost: CPU since the last report, peak RSS, report time ***/
+			if (getrusage(RUSAGE_SELF, &ru))
+				fail_errno("Monitor cannot get resource usage");
+			snprintf(line, sizeof line, "%s monitor targets=%d cpu_ms=%.3lf cpu_pct=%.4lf rss_kb=%ld report_us=%.1lf\n",
+				 stamp, n_targets, (cpu_ns(&ru) - cpu_ns(&ru_prev)) / 1e6,
+				 100.0 * (cpu_ns(&ru) - cpu_ns(&ru_prev)) / (double)(now - last_report), ru.ru_maxrss,
+				 (now_ns() - report_start) / 1e3);
+			emit(line, out, report_socket);
+			ru_prev = ru;
+			last_report = now;
+			while (next_report <= now)
+				next_report += mo.interval_ns;
+		}
+	}
+
+	for (i = 0; i < n_targets; i++) {
+		probe_close(targets[i].session);
+		free(targets[i].windows);
+	}
+	free(merged);
+	if (out != stdout)
+		fclose(out);
+	if (report_socket >= 0)
+		close(report_socket);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,704 @@
+/*
+ * pingpong_relay.c: relay da interporre fra i client ping e pong_server
+ *                   (tipicamente tutti su localhost) che aggiunge ritardi,
+ *                   jitter, perdite, riordinamenti e limiti di banda noti,
+ *                   in modo da poter verificare l'accuratezza delle misure
+ *                   senza netem e senza privilegi di root.
+ *                   Per ogni connessione di controllo il relay (mediante una
+ *                   fork()) crea un processo dedicato che inoltra in entrambe
+ *                   le direzioni sia la connessione TCP sia, per i test UDP,
+ *                   i datagrammi sulla porta annunciata nella risposta "OK".
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+#include "pingpong.h"
+
+#define WHEEL_SLOTS 4096	/* must be a power of two */
+#define WHEEL_TICK_NS 1000	/* scheduling resolution: 1 us */
+#define RELAY_CHUNK 16384	/* bytes taken from a TCP socket at a time */
+#define RELAY_MAX_QUEUED (4 * 1024 * 1024)	/* per direction: TCP stops reading, UDP drops */
+#define RELAY_SPIN_US 20.0	/* default busy-wait before a deadline */
+#define RELAY_BATCH 64		/* datagrams taken from a socket per wakeup */
+
+enum { C2S, S2C };		/* client to server, server to client */
+enum { DIST_UNIFORM, DIST_NORMAL, DIST_EXPONENTIAL, DIST_PARETO };
+
+static const char *const dist_names[] = { "uniform", "normal", "exponential", "pareto" };
+
+/* What the relay does to every packet, the same in both directions */
+struct impairment {
+	int64_t delay_ns;	/* fixed one-way delay */
+	int64_t jitter_ns;	/* scale of the random part, see jitter_sample() */
+	int distribution;
+	double loss;		/* probability of dropping a datagram */
+	double reorder;		/* probability of sending a datagram without delay */
+	double rate_bps;	/* bottleneck bandwidth, 0 for none */
+	int64_t spin_ns;	/* busy-wait this long before a deadline */
+	long seed;
+};
+
+struct packet {
+	struct packet *next;
+	int64_t tick;		/* release time in wheel ticks */
+	int dir, is_udp, eof;
+	size_t len, cap;
+	char *data;
+};
+
+/*
+ * Hashed timer wheel: a packet due at tick t waits in slot t % WHEEL_SLOTS,
+ * in FIFO order, together with packets due one or more rotations later.
+ * The bitmap of non-empty slots lets the loop find the next deadline
+ * without walking empty slots.
+ */
+struct timer_wheel {
+	struct packet *head[WHEEL_SLOTS], *tail[WHEEL_SLOTS];
+	uint64_t busy[WHEEL_SLOTS / 64];
+	int64_t tick;		/* every packet due up to here has been released */
+	long pending;
+};
+
+/* Tracks the control protocol in one direction of the TCP connection */
+struct stream_parser {
+	long long data_left;	/* payload to relay before the next control line */
+	long long data_next;	/* payload announced for after the next "OK" (S2C) */
+	int udp_next;		/* the next "OK" carries a UDP port to rewrite (S2C) */
+	int messages_left;	/* "var=1": messages to come, each a "seq size" line and its payload */
+	int messages_next;	/* the same, for after the next "OK" (S2C) */
+	size_t line_len;
+	char line[MAX_REQ];
+};
+
+struct relay {
+	struct impairment imp;
+	unsigned short rand_state[3];
+	struct timer_wheel wheel;
+	struct packet *free_list;
+	int epoll_fd, timer_fd;
+	int64_t timer_armed;
+	int tcp_fd[2];		/* source socket of each direction: client, server */
+	int udp_fd[2];		/* -1 until a UDP test is accepted */
+	int server_udp_port;
+	struct sockaddr_in server_addr;
+	struct sockaddr_storage udp_client_addr;
+	socklen_t udp_client_len;
+	int reading[2], eof_sent[2], broken;
+	int64_t last_release[2], link_free[2];
+	size_t queued[2];
+	struct stream_parser parse[2];
+	unsigned long long bytes[2], datagrams[2], dropped[2];
+};
+
+static struct relay relay;	/* one relay per child process */
+
+void sigchld_handler(int signum)
+{
+	int status, saved_errno = errno;
+	while (waitpid(-1, &status, WNOHANG) > 0)
+		;
+	errno = saved_errno;
+}
+
+static int64_t wheel_next_busy(const struct timer_wheel *w, int64_t from)
+{
+	int64_t t = from;
+	while (t < from + WHEEL_SLOTS) {
+		int slot = (int)(t & (WHEEL_SLOTS - 1));
+		uint64_t word = w->busy[slot / 64] >> (slot % 64);
+		if (word)
+			return t + __builtin_ctzll(word);
+		t += 64 - slot % 64;
+	}
+	return -1;
+}
+
+static void wheel_insert(struct timer_wheel *w, struct packet *p)
+{
+	int slot;
+	if (p->tick <= w->tick)
+		p->tick = w->tick + 1;
+	slot = (int)(p->tick & (WHEEL_SLOTS - 1));
+	p->next = NULL;
+	if (w->tail[slot])
+		w->tail[slot]->next = p;
+	else
+		w->head[slot] = p;
+	w->tail[slot] = p;
+	w->busy[slot / 64] |= 1ULL << (slot % 64);
+	w->pending++;
+}
+
+static struct packet *packet_get(struct relay *r, size_t len)
+{
+	struct packet *p = r->free_list;
+	if (p)
+		r->free_list = p->next;
+	else if ((p = calloc(1, sizeof *p)) == NULL)
+		fail_errno("Relay cannot allocate a packet");
+	if (p->cap < len) {
+		if ((p->data = realloc(p->data, len)) == NULL)
+			fail_errno("Relay cannot allocate a packet buffer");
+		p->cap = len;
+	}
+	p->len = len;
+	p->eof = 0;
+	return p;
+}
+
+/* Extra delay in ns: uniform in [-J, J], normal with standard deviation J,
+   exponential or Pareto (shape 3, heavy tailed) with mean J */
+static double jitter_sample(struct relay *r)
+{
+	const double j = (double)r->imp.jitter_ns;
+	double u = erand48(r->rand_state), xm;
+	switch (r->imp.distribution) {
+	case DIST_NORMAL:
+		return j * sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * erand48(r->rand_state));
+	case DIST_EXPONENTIAL:
+		return -j * log(1.0 - u);
+	case DIST_PARETO:
+		xm = 2.0 * j;
+		return xm * pow(1.0 - u, -1.0 / 3.0) - xm;
+	default:
+		return j * (2.0 * u - 1.0);
+	}
+}
+
+static void set_reading(struct relay *r, int dir, int on)
+{
+	struct epoll_event ev = { .events = on ? EPOLLIN : 0, .data.fd = r->tcp_fd[dir] };
+	if (r->reading[dir] == on || r->reading[dir] < 0)
+		return;
+	if (epoll_ctl(r->epoll_fd, EPOLL_CTL_MOD, r->tcp_fd[dir], &ev))
+		fail_errno("Relay cannot change epoll interest");
+	r->reading[dir] = on;
+}
+
+/*
+ * Queues len bytes travelling in direction dir. The packet first waits
+ * for the bottleneck to be free and to serialize it, then for the delay
+ * plus jitter. TCP data never overtakes earlier data of its direction;
+ * datagrams may, which is how jitter and "reorder" reorder them.
+ */
+static void schedule(struct relay *r, int dir, int is_udp, const void *data, size_t len, int eof)
+{
+	const struct impairment *imp = &r->imp;
+	int64_t now = now_ns(), release = now, extra;
+	struct packet *p;
+
+	if (is_udp && ((imp->loss > 0 && erand48(r->rand_state) < imp->loss) ||
+		       r->queued[dir] + len > RELAY_MAX_QUEUED)) {
+		r->dropped[dir]++;
+		return;
+	}
+	if (imp->rate_bps > 0 && len > 0) {
+		if (r->link_free[dir] < now)
+			r->link_free[dir] = now;
+		r->link_free[dir] += (int64_t)(len * 8.0e9 / imp->rate_bps);
+		release = r->link_free[dir];
+	}
+	extra = imp->delay_ns;
+	if (imp->jitter_ns)
+		extra += (int64_t)jitter_sample(r);
+	if (is_udp && imp->reorder > 0 && erand48(r->rand_state) < imp->reorder)
+		extra = 0;
+	if (extra > 0)
+		release += extra;
+	if (!is_udp) {
+		if (release < r->last_release[dir])
+			release = r->last_release[dir];
+		r->last_release[dir] = release;
+	}
+	p = packet_get(r, len);
+	memcpy(p->data, data, len);
+	p->dir = dir;
+	p->is_udp = is_udp;
+	p->eof = eof;
+	p->tick = release / WHEEL_TICK_NS;
+	wheel_insert(&r->wheel, p);
+	r->queued[dir] += len;
+	if (!is_udp && r->queued[dir] > RELAY_MAX_QUEUED)
+		set_reading(r, dir, 0);
+}
+
+static void deliver(struct relay *r, struct packet *p)
+{
+	const int dst = p->dir == C2S ? r->tcp_fd[S2C] : r->tcp_fd[C2S];
+	r->queued[p->dir] -= p->len;
+	if (p->is_udp) {
+		ssize_t n;
+		if (p->dir == C2S)
+			n = send(r->udp_fd[S2C], p->data, p->len, 0);
+		else if (r->udp_client_len)
+			n = sendto(r->udp_fd[C2S], p->data, p->len, 0,
+				   (struct sockaddr *)&r->udp_client_addr, r->udp_client_len);
+		else
+			n = -1;
+		if (n == (ssize_t)p->len)
+			r->datagrams[p->dir]++;
+		else
+			r->dropped[p->dir]++;
+		return;
+	}
+	if (p->eof) {
+		shutdown(dst, SHUT_WR);
+		r->eof_sent[p->dir] = 1;
+		return;
+	}
+	if (blocking_write_all(dst, p->data, p->len) != (ssize_t)p->len) {
+		r->broken = 1;
+		return;
+	}
+	r->bytes[p->dir] += p->len;
+	if (!r->reading[p->dir] && !r->eof_sent[p->dir] && r->queued[p->dir] <= RELAY_MAX_QUEUED / 2)
+		set_reading(r, p->dir, 1);
+}
+
+/* Releases, in deadline order, every packet due by now */
+static void wheel_run(struct relay *r, int64_t now)
+{
+	struct timer_wheel *w = &r->wheel;
+	const int64_t now_tick = now / WHEEL_TICK_NS;
+	int64_t t;
+
+	while (w->pending && (t = wheel_next_busy(w, w->tick + 1)) != -1 && t <= now_tick) {
+		const int slot = (int)(t & (WHEEL_SLOTS - 1));
+		struct packet **pp = &w->head[slot], *p, *last = NULL;
+		w->tick = t;
+		while ((p = *pp) != NULL) {
+			if (p->tick > t) {	/* due in a later rotation */
+				last = p;
+				pp = &p->next;
+				continue;
+			}
+			*pp = p->next;
+			w->pending--;
+			deliver(r, p);
+			p->next = r->free_list;
+			r->free_list = p;
+		}
+		w->tail[slot] = last;
+		if (!w->head[slot])
+			w->busy[slot / 64] &= ~(1ULL << (slot % 64));
+	}
+	if (now_tick > w->tick)
+		w->tick = now_tick;
+}
+
+static int open_relay_udp(int port)
+{
+	struct sockaddr_in addr;
+	int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP), rcvbuf = RELAY_MAX_QUEUED;
+	if (fd < 0)
+		fail_errno("Relay cannot create a UDP socket");
+	/* bursts wait in the kernel while the loop sends; capped by rmem_max */
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons((unsigned short)port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof addr))
+		fail_errno("Relay cannot bind a UDP socket");
+	if (fcntl(fd, F_SETFL, O_NONBLOCK))
+		fail_errno("Relay cannot make a UDP socket non-blocking");
+	return fd;
+}
+
+/* Opens the UDP leg announced by the server and returns the relay's own port */
+static int setup_udp(struct relay *r, int server_port)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof addr;
+	struct epoll_event ev = { .events = EPOLLIN };
+	int dir;
+
+	if (r->udp_fd[C2S] < 0 || server_port != r->server_udp_port) {
+		for (dir = C2S; dir <= S2C; dir++)
+			if (r->udp_fd[dir] >= 0)
+				close(r->udp_fd[dir]);
+		r->udp_fd[C2S] = open_relay_udp(0);
+		r->udp_fd[S2C] = open_relay_udp(0);
+		addr = r->server_addr;
+		addr.sin_port = htons((unsigned short)server_port);
+		if (connect(r->udp_fd[S2C], (struct sockaddr *)&addr, sizeof addr))
+			fail_errno("Relay cannot connect to the server UDP port");
+		for (dir = C2S; dir <= S2C; dir++) {
+			ev.data.fd = r->udp_fd[dir];
+			if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->udp_fd[dir], &ev))
+				fail_errno("Relay cannot watch a UDP socket");
+		}
+		r->server_udp_port = server_port;
+		r->udp_client_len = 0;
+	}
+	if (getsockname(r->udp_fd[C2S], (struct sockaddr *)&addr, &len))
+		fail_errno("Relay cannot get its UDP port");
+	return ntohs(addr.sin_port);
+}
+
+/* A complete control line: tells how much opaque payload follows it and
+   rewrites the UDP port the server announces with the relay's own */
+static void handle_line(struct relay *r, int dir, char *line, size_t len)
+{
+	struct stream_parser *c2s = &r->parse[C2S], *s2c = &r->parse[S2C];
+	int size, norep, port;
+	char *resp;
+
+	if (dir == C2S) {
+		if (sscanf(line, "TCP %d %d", &size, &norep) == 2) {
+			resp = strstr(line, " resp=");
+			c2s->data_left = (long long)size * norep;
+			s2c->data_next = (long long)(resp ? atoi(resp + 6) : size) * norep;
+			if (strstr(line, " var=1")) {
+				c2s->data_left = s2c->data_next = 0;
+				c2s->messages_left = s2c->messages_next = norep;
+			}
+		} else if (sscanf(line, "UDP %d %d", &size, &norep) == 2) {
+			s2c->udp_next = 1;
+		}
+	} else if (strncmp(line, "OK", 2) == 0) {
+		if (s2c->udp_next && sscanf(line, "OK %d", &port) == 1) {
+			len = (size_t)snprintf(line, MAX_REQ, "OK %d\n", setup_udp(r, port));
+		}
+		s2c->data_left = s2c->data_next;
+		s2c->messages_left = s2c->messages_next;
+		s2c->data_next = 0;
+		s2c->messages_next = 0;
+		s2c->udp_next = 0;
+	} else if (strncmp(line, "ERROR", 5) == 0) {
+		c2s->data_left = s2c->data_next = 0;
+		c2s->messages_left = s2c->messages_next = 0;
+		s2c->udp_next = 0;
+	}
+	schedule(r, dir, 0, line, len, 0);
+}
+
+static void relay_stream(struct relay *r, int dir, const char *buf, size_t n)
+{
+	struct stream_parser *sp = &r->parse[dir];
+	size_t off = 0;
+	while (off < n) {
+		if (sp->data_left > 0) {
+			size_t k = n - off;
+			if ((long long)k > sp->data_left)
+				k = (size_t)sp->data_left;
+			schedule(r, dir, 0, buf + off, k, 0);
+			sp->data_left -= (long long)k;
+			off += k;
+			continue;
+		}
+		sp->line[sp->line_len++] = buf[off++];
+		if (sp->line[sp->line_len - 1] == '\n') {
+			int size;
+			sp->line[sp->line_len] = 0;
+			if (sp->messages_left > 0 && sscanf(sp->line, "%*d %d", &size) == 1) {
+				/* header of a variable size message: its payload follows */
+				schedule(r, dir, 0, sp->line, sp->line_len, 0);
+				sp->data_left = size > (int)sp->line_len ? size - (long long)sp->line_len : 0;
+				sp->messages_left--;
+			} else
+				handle_line(r, dir, sp->line, sp->line_len);
+			sp->line_len = 0;
+		} else if (sp->line_len == sizeof sp->line - 1) {	/* not a control line */
+			schedule(r, dir, 0, sp->line, sp->line_len, 0);
+			sp->line_len = 0;
+		}
+	}
+}
+
+static void read_tcp(struct relay *r, int dir)
+{
+	static char buf[RELAY_CHUNK];
+	ssize_t n = read(r->tcp_fd[dir], buf, sizeof buf);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (n > 0) {
+		relay_stream(r, dir, buf, (size_t)n);
+		return;
+	}
+	if (r->parse[dir].line_len)	/* incomplete last line */
+		schedule(r, dir, 0, r->parse[dir].line, r->parse[dir].line_len, 0);
+	r->parse[dir].line_len = 0;
+	schedule(r, dir, 0, NULL, 0, 1);
+	set_reading(r, dir, 0);
+	if (epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, r->tcp_fd[dir], NULL))
+		fail_errno("Relay cannot stop watching a TCP socket");
+	r->reading[dir] = -1;	/* never again */
+}
+
+static void read_udp(struct relay *r, int dir)
+{
+	static char buf[MAXUDPSIZE];
+	int i;
+	for (i = 0; i < RELAY_BATCH; i++) {
+		struct sockaddr_storage from;
+		socklen_t from_len = sizeof from;
+		ssize_t n = recvfrom(r->udp_fd[dir], buf, sizeof buf, 0, (struct sockaddr *)&from, &from_len);
+		if (n < 0)
+			break;
+		if (dir == C2S) {
+			r->udp_client_addr = from;
+			r->udp_client_len = from_len;
+		}
+		schedule(r, dir, 1, buf, (size_t)n, 0);
+	}
+}
+
+/* Sleeps until the next packet is due or a socket is readable, then
+   busy-waits the last spin_ns to release packets on time */
+static int wait_events(struct relay *r, struct epoll_event *events, int max_events, int tcp_done)
+{
+	int64_t next = -1, now = now_ns();
+	int timeout = -1;
+
+	if (r->wheel.pending) {
+		int64_t t = wheel_next_busy(&r->wheel, r->wheel.tick + 1);
+		if (t != -1)
+			next = t * WHEEL_TICK_NS;
+	}
+	if (next != -1 && next - now <= r->imp.spin_ns) {
+		timeout = 0;
+	} else if (next != -1) {
+		int64_t wake = next - r->imp.spin_ns;
+		if (wake != r->timer_armed) {
+			struct itimerspec its = { .it_value = { .tv_sec = wake / 1000000000, .tv_nsec = wake % 1000000000 } };
+			if (timerfd_settime(r->timer_fd, TFD_TIMER_ABSTIME, &its, NULL))
+				fail_errno("Relay cannot arm its timer");
+			r->timer_armed = wake;
+		}
+	} else if (tcp_done) {
+		timeout = PONGRECVTOUT * 1000;	/* UDP test over when idle */
+	}
+	return epoll_wait(r->epoll_fd, events, max_events, timeout);
+}
+
+void relay_session(int client_socket, const struct sockaddr_in *server_addr, const struct impairment *imp)
+{
+	struct relay *r = &relay;
+	struct epoll_event ev = { .events = EPOLLIN }, events[16];
+	int server_socket, one = 1, dir, n, i;
+
+	memset(r, 0, sizeof *r);
+	r->imp = *imp;
+	r->rand_state[0] = 0x330e;
+	r->rand_state[1] = (unsigned short)imp->seed;
+	r->rand_state[2] = (unsigned short)(imp->seed >> 16);
+	r->udp_fd[C2S] = r->udp_fd[S2C] = -1;
+	r->server_addr = *server_addr;
+	r->wheel.tick = now_ns() / WHEEL_TICK_NS;
+	r->timer_armed = -1;
+
+	if ((server_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+		fail_errno("Relay cannot create a socket");
+	if (connect(server_socket, (const struct sockaddr *)server_addr, sizeof *server_addr))
+		fail_errno("Relay cannot connect to the pong server");
+	r->tcp_fd[C2S] = client_socket;
+	r->tcp_fd[S2C] = server_socket;
+	if ((r->epoll_fd = epoll_create1(0)) < 0)
+		fail_errno("Relay cannot create an epoll instance");
+	if ((r->timer_fd = timerfd_create(CLOCK_TYPE, TFD_NONBLOCK)) < 0)
+		fail_errno("Relay cannot create a timer");
+	ev.data.fd = r->timer_fd;
+	if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->timer_fd, &ev))
+		fail_errno("Relay cannot watch its timer");
+	for (dir = C2S; dir <= S2C; dir++) {
+		setsockopt(r->tcp_fd[dir], IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+		ev.data.fd = r->tcp_fd[dir];
+		if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->tcp_fd[dir], &ev))
+			fail_errno("Relay cannot watch a TCP socket");
+		r->reading[dir] = 1;
+	}
+
+	while (!r->broken) {
+		const int tcp_done = r->eof_sent[C2S] && r->eof_sent[S2C];
+		if (tcp_done && !r->wheel.pending && r->udp_fd[C2S] < 0)
+			break;
+		n = wait_events(r, events, sizeof events / sizeof events[0], tcp_done);
+		if (n < 0 && errno != EINTR)
+			fail_errno("Relay cannot wait for events");
+		if (n == 0 && tcp_done && !r->wheel.pending)
+			break;
+		for (i = 0; i < n; i++) {
+			const int fd = events[i].data.fd;
+			uint64_t expirations;
+			if (fd == r->timer_fd) {
+				if (read(fd, &expirations, sizeof expirations) < 0 && errno != EAGAIN)
+					fail_errno("Relay cannot read its timer");
+				r->timer_armed = -1;
+			}
+			for (dir = C2S; dir <= S2C; dir++) {
+				if (fd == r->tcp_fd[dir] && r->reading[dir] == 1)
+					read_tcp(r, dir);
+				else if (fd == r->udp_fd[dir])
+					read_udp(r, dir);
+			}
+		}
+		wheel_run(r, now_ns());
+	}
+	fprintf(stderr, "Relay session: %llu/%llu TCP bytes, %llu/%llu datagrams relayed, %llu/%llu dropped (client to server/server to client)\n",
+		r->bytes[C2S], r->bytes[S2C], r->datagrams[C2S], r->datagrams[S2C], r->dropped[C2S], r->dropped[S2C]);
+	exit(EXIT_SUCCESS);
+}
+
+void relay_loop(int listen_socket, const struct sockaddr_in *server_addr, const struct impairment *imp)
+{
+	struct impairment child_imp = *imp;
+	for (;;) {
+		int client_socket = accept(listen_socket, NULL, NULL);
+		pid_t pid;
+		if (client_socket == -1) {
+			if (errno == EINTR)
+				continue;
+			fail_errno("Relay could not accept client connection");
+		}
+		child_imp.seed++;	/* reproducible, yet not identical, sessions */
+		if ((pid = fork()) < 0)
+			fail_errno("Relay could not fork");
+		if (pid == 0) {
+			close(listen_socket);
+			relay_session(client_socket, server_addr, &child_imp);
+		}
+		if (close(client_socket))
+			fail_errno("Relay cannot close client socket");
+	}
+}
+
+static double parse_rate(const char *arg)
+{
+	char *end;
+	double rate = strtod(arg, &end);
+	switch (*end) {
+	case 'k': case 'K':
+		rate *= 1e3;
+		break;
+	case 'm': case 'M':
+		rate *= 1e6;
+		break;
+	case 'g': case 'G':
+		rate *= 1e9;
+		break;
+	}
+	return rate;
+}
+
+static const char *const usage =
+	"Relay incorrect syntax. Use: pingpong_relay [-d US] [-j US] [-D uniform|normal|exponential|pareto]\n"
+	"\t[-l PCT] [-o PCT] [-b BITS/S] [-s SEED] [-w US] LISTEN-PORT PONG-ADDRESS PONG-PORT";
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{ "delay", required_argument, NULL, 'd' },
+		{ "jitter", required_argument, NULL, 'j' },
+		{ "distribution", required_argument, NULL, 'D' },
+		{ "loss", required_argument, NULL, 'l' },
+		{ "reorder", required_argument, NULL, 'o' },
+		{ "rate", required_argument, NULL, 'b' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "spin", required_argument, NULL, 'w' },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct impairment imp = { .spin_ns = (int64_t)(RELAY_SPIN_US * 1000.0), .seed = (long)getpid() ^ (long)time(NULL) };
+	struct addrinfo gai_hints, *addrinfo;
+	struct sockaddr_in server_addr, listen_addr;
+	struct sigaction sigchld_action;
+	int listen_socket, gai_rv, opt, i;
+
+	while ((opt = getopt_long(argc, argv, "d:j:D:l:o:b:s:w:", long_options, NULL)) != -1)
+		switch (opt) {
+		case 'd':
+			imp.delay_ns = (int64_t)(atof(optarg) * 1000.0);
+			break;
+		case 'j':
+			imp.jitter_ns = (int64_t)(atof(optarg) * 1000.0);
+			break;
+		case 'D':
+			for (i = 0; i < (int)(sizeof dist_names / sizeof dist_names[0]); i++)
+				if (strcmp(optarg, dist_names[i]) == 0)
+					break;
+			if (i == (int)(sizeof dist_names / sizeof dist_names[0]))
+				fail("Relay: unknown jitter distribution");
+			imp.distribution = i;
+			break;
+		case 'l':
+			imp.loss = atof(optarg) / 100.0;
+			break;
+		case 'o':
+			imp.reorder = atof(optarg) / 100.0;
+			break;
+		case 'b':
+			imp.rate_bps = parse_rate(optarg);
+			break;
+		case 's':
+			imp.seed = atol(optarg);
+			break;
+		case 'w':
+			imp.spin_ns = (int64_t)(atof(optarg) * 1000.0);
+			break;
+		default:
+			fail(usage);
+		}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc != 4)
+		fail(usage);
+	if (imp.delay_ns < 0 || imp.jitter_ns < 0 || imp.loss < 0 || imp.loss > 1 ||
+	    imp.reorder < 0 || imp.reorder > 1 || imp.rate_bps < 0 || imp.spin_ns < 0)
+		fail("Relay: delays, percentages and rates must be non-negative (percentages up to 100)");
+
+	memset(&gai_hints, 0, sizeof gai_hints);
+	gai_hints.ai_family = AF_INET;
+	gai_hints.ai_socktype = SOCK_STREAM;
+	gai_hints.ai_protocol = IPPROTO_TCP;
+	if ((gai_rv = getaddrinfo(argv[2], argv[3], &gai_hints, &addrinfo)) != 0)
+		fail(gai_strerror(gai_rv));
+	memcpy(&server_addr, addrinfo->ai_addr, sizeof server_addr);
+	freeaddrinfo(addrinfo);
+
+	if ((listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+		fail_errno("Relay cannot create socket");
+	memset(&listen_addr, 0, sizeof listen_addr);
+	listen_addr.sin_family = AF_INET;
+	listen_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	listen_addr.sin_port = htons((unsigned short)atoi(argv[1]));
+	if (bind(listen_socket, (struct sockaddr *)&listen_addr, sizeof listen_addr))
+		fail_errno("Relay cannot bind socket");
+	if (listen(listen_socket, LISTENBACKLOG) < 0)
+		fail_errno("Relay cannot listen");
+
+	/* default timer slack (50 us) would swamp the microsecond wheel */
+	if (prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0))
+		fail_errno("Relay cannot set its timer slack");
+	signal(SIGPIPE, SIG_IGN);
+	sigchld_action.sa_handler = sigchld_handler;
+	if (sigemptyset(&sigchld_action.sa_mask))
+		fail_errno("Relay cannot initialize signal mask");
+	sigchld_action.sa_flags = SA_NOCLDSTOP | SA_RESTART;
+	if (sigaction(SIGCHLD, &sigchld_action, NULL))
+		fail_errno("Relay cannot register SIGCHLD handler");
+	fprintf(stderr, "Relay listening on port %s, forwarding to %s:%s (delay %.1lf us, jitter %.1lf us %s, loss %.2lf%%, reorder %.2lf%%, rate %.0lf bit/s)\n",
+		argv[1], argv[2], argv[3], imp.delay_ns / 1000.0, imp.jitter_ns / 1000.0, dist_names[imp.distribution],
+		imp.loss * 100.0, imp.reorder * 100.0, imp.rate_bps);
+	relay_loop(listen_socket, &server_addr, &imp);
+	return 0;
+}
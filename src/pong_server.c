@@ -23,54 +23,245 @@
  */
 
 #include <signal.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
 #include "pingpong.h"
 
 void sigchld_handler(int signum)
 {
-	int status;
-	if (waitpid(-1, &status, WNOHANG) == -1)
+	int status, saved_errno = errno;
+	pid_t pid;
+	/* signals coalesce at high connection rates: reap every child that is done */
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		;
+	if (pid == -1 && errno != ECHILD)
 		fail("Pong Server cannot wait for children in SIGCHLD handler");
+	errno = saved_errno;
 }
 
-void tcp_pong(int message_no, size_t message_size, FILE *in_stream, int out_socket)
+struct pong_request {
+	int is_tcp, is_udp;
+	int message_size, message_no;
+	int response_size;	/* == message_size unless the client sent "resp=" */
+	int timestamps;		/* "ts=1": server timestamps in every reply */
+	int loss;		/* "loss=1": UDP loss measurement, never aborts */
+	int is_stream, stream_up;	/* "STREAM size up|down": bulk transfer */
+	int stream_ms;		/* "time=MS" */
+	long long stream_bytes;	/* "bytes=N" */
+	int interval_ms;	/* "interval=MS" between throughput reports */
+	int sendfile;		/* "sendfile=1": send with sendfile() */
+	int tcpinfo_every;	/* "tcpinfo=N": TCP_INFO sample every N messages */
+	char congestion[CC_NAME_MAX];	/* "cc=ALGO": TCP_CONGESTION, "" for the default */
+	int variable;		/* "var=1": messages of any size up to message_size */
+	struct sock_options sockopts;	/* "so=LIST" */
+};
+
+/*
+ * Message buffers of a pong child: "in" receives the requests, "out" is
+ * the pre-filled response used when the response size differs from the
+ * request size. Both only grow, so a session allocates them once.
+ */
+struct pong_buffers {
+	char *in, *out;
+	size_t in_size, out_size;
+};
+
+void reserve_buffers(struct pong_buffers *buf, const struct pong_request *req)
+{
+	if ((size_t)req->message_size > buf->in_size) {
+		if (!(buf->in = realloc(buf->in, (size_t)req->message_size)))
+			fail("Pong Server cannot allocate message buffer");
+		buf->in_size = (size_t)req->message_size;
+	}
+	if ((size_t)req->response_size > buf->out_size) {
+		if (!(buf->out = realloc(buf->out, (size_t)req->response_size)))
+			fail("Pong Server cannot allocate response buffer");
+		memset(buf->out + buf->out_size, 0, (size_t)req->response_size - buf->out_size);
+		buf->out_size = (size_t)req->response_size;
+	}
+}
+
+/*
+ * Returns the reply to the message in buf->in carrying sequence number seq:
+ * the message itself for symmetric tests, otherwise the pre-filled response
+ * buffer stamped with the same sequence number.
+ */
+char *prepare_reply(const struct pong_request *req, struct pong_buffers *buf, int seq)
+{
+	if (req->response_size == req->message_size)
+		return buf->in;
+	sprintf(buf->out, "%d\n", seq);
+	return buf->out;
+}
+
+int64_t receive_timestamp(const struct pong_request *req)
 {
-	char buffer[message_size], *cp;
-	int n_msg, n_c;
+	struct timespec rx_time;
+	if (!req->timestamps)
+		return 0;
+	if (clock_gettime(TS_CLOCK_TYPE, &rx_time) == -1)
+		fail_errno("Pong Server cannot get time");
+	return timespec2ns(&rx_time);
+}
+
+/*
+ * Writes into the reply the time its request was fully received and,
+ * as late as possible, the time the reply starts to be sent.
+ */
+void stamp_reply(const struct pong_request *req, char *reply, int64_t rx_ns)
+{
+	struct timespec tx_time;
+	if (!req->timestamps)
+		return;
+	put_timestamp(reply + PONG_TS_OFFSET, rx_ns);
+	if (clock_gettime(TS_CLOCK_TYPE, &tx_time) == -1)
+		fail_errno("Pong Server cannot get time");
+	put_timestamp(reply + PONG_TS_OFFSET + sizeof(int64_t), timespec2ns(&tx_time));
+}
+
+/* pong_server -p: CPU counters of every ping-pong test, on stderr */
+static int count_perf;
+
+int perf_test_begin(struct perf_counters *pc)
+{
+	if (!count_perf)
+		return 0;
+	if (perf_open(pc)) {
+		fprintf(stderr, "Pong Server: no performance counters: %s\n", strerror(errno));
+		return 0;
+	}
+	perf_begin(pc);
+	return 1;
+}
+
+void perf_test_end(struct perf_counters *pc, const struct pong_request *req)
+{
+	char name[64];
+	perf_end(pc);
+	snprintf(name, sizeof name, "Pong %d %s %d bytes: CPU counters", (int)getpid(), req->is_udp ? "UDP" : "TCP",
+		 req->message_size);
+	print_perf_counters(stderr, name, pc, req->message_no);
+	perf_close(pc);
+}
+
+/*
+ * Size of a message of a "var=1" test, from its "seq size" first line
+ * (header_len bytes, the newline included); fails if it is not valid.
+ */
+size_t variable_size(const struct pong_request *req, const char *header, size_t header_len)
+{
+	char line[32];
+	int seq, size;
+	if (header_len >= sizeof line)
+		fail("Pong Server received an invalid message header");
+	memcpy(line, header, header_len);
+	line[header_len] = 0;
+	if (sscanf(line, "%d %d", &seq, &size) != 2 || size < MINSIZE || size > req->message_size || (size_t)size < header_len)
+		fail("Pong Server received an invalid message size");
+	return (size_t)size;
+}
+
+/*
+ * With "tcpinfo=N" the connection's TCP_INFO is sampled before the first
+ * message and after the reply to every N-th and to the last one (the
+ * client samples at the same points); the samples follow the last reply
+ * on the connection (write_tcpinfo_report()).
+ */
+void tcp_pong(const struct pong_request *req, FILE *in_stream, int out_socket, struct pong_buffers *buf)
+{
+	const int message_no = req->message_no, every = req->tcpinfo_every;
+	const size_t message_size = (size_t)req->message_size;
+	char *buffer = buf->in, *cp, *reply;
+	size_t size, reply_size;
+	int n_msg, n_c, n_samples = 0, header;
+	int64_t rx_ns, wait_ns, first_ns = 0, read_ns;
+	struct perf_counters pc;
+	struct tcp_sample *samples = NULL;
+	int counting;
+	if (every) {
+		if ((samples = malloc((size_t)tcp_sample_count(every, message_no) * sizeof *samples)) == NULL)
+			fail_errno("Pong Server cannot allocate TCP_INFO samples");
+		if (tcp_sample_take(out_socket, 0, &samples[n_samples++]))
+			fail_errno("Pong Server cannot read TCP_INFO");
+	}
+	counting = perf_test_begin(&pc);
+	trace_test(0, req->message_size);
 	for (n_msg = 1; n_msg <= message_no; ++n_msg)
 	{
 		int seq = 0;
 		debug(" tcp_pong: n_msg=%d\n", n_msg);
-		for (cp = buffer, n_c = 0; n_c < message_size; ++n_c, ++cp)
+		wait_ns = trace_now();
+		/* with "var=1" the first line of the message tells its size */
+		for (cp = buffer, n_c = 0, size = message_size, header = req->variable; n_c < size; ++n_c, ++cp)
 		{
 			int cc = getc(in_stream);
 			if (cc == EOF)
 				fail("TCP Pong received fewer bytes than expected");
 			*cp = (char)cc;
+			if (n_c == 0)
+				first_ns = trace_now();
+			if (header && cc == '\n') {
+				size = variable_size(req, buffer, (size_t)n_c + 1);
+				header = 0;
+			}
 		}
+		if (sock_quickack(out_socket, &req->sockopts))
+			fail_errno("TCP Pong cannot set TCP_QUICKACK");
+		read_ns = trace_now();
+		rx_ns = receive_timestamp(req);
 		if (sscanf(buffer, "%d\n", &seq) != 1)
 			fail("TCP Pong got invalid message");
 		debug(" tcp_pong: got %d sequence number (expecting %d)\n%s\n", seq, n_msg, buffer);
 		if (seq != n_msg)
 			fail("TCP Pong received wrong message sequence number");
-		if (blocking_write_all(out_socket, buffer, message_size) != message_size)
+		reply = prepare_reply(req, buf, seq);
+		stamp_reply(req, reply, rx_ns);
+		reply_size = req->variable ? size : (size_t)req->response_size;
+		if (sock_cork(out_socket, &req->sockopts, 1) ||
+		    blocking_write_all(out_socket, reply, reply_size) != reply_size ||
+		    sock_cork(out_socket, &req->sockopts, 0))
 			fail_errno("TCP Pong failed sending data back");
+		if (trace_on) {
+			trace_add(TRACE_WAIT, seq, wait_ns, first_ns);
+			trace_add(TRACE_READ, seq, first_ns, read_ns);
+			trace_mark(TRACE_REPLY, seq, read_ns);
+		}
+		if (every && tcp_sample_due(n_msg, every, message_no) && tcp_sample_take(out_socket, n_msg, &samples[n_samples++]))
+			fail_errno("Pong Server cannot read TCP_INFO");
+	}
+	if (counting)
+		perf_test_end(&pc, req);
+	if (every) {
+		if (write_tcpinfo_report(out_socket, samples, n_samples))
+			fail_errno("Pong Server cannot send the TCP_INFO samples");
+		free(samples);
 	}
 }
 
-void udp_pong(int dgrams_no, int dgram_sz, int pong_socket)
+void udp_pong(const struct pong_request *req, int pong_socket, struct pong_buffers *buf)
 {
-	char buffer[dgram_sz];
+	const int dgrams_no = req->message_no, dgram_sz = req->message_size;
+	char *buffer = buf->in, *reply;
 	ssize_t received_bytes;
 	int n, resend;
+	int64_t rx_ns;
 	struct sockaddr_storage ping_addr;
 	socklen_t ping_addr_len;
+	int64_t wait_ns, read_ns;
+	struct perf_counters pc;
+	const int counting = perf_test_begin(&pc);
+	trace_test(1, dgram_sz);
 	for (n = resend = 0; n < dgrams_no;)
 	{
 		int i;
 		ping_addr_len = sizeof(struct sockaddr_storage);
-		if ((received_bytes = recvfrom(pong_socket, buffer, sizeof buffer, 0, (struct sockaddr *)&ping_addr, &ping_addr_len)) < 0)
+		wait_ns = trace_now();
+		if ((received_bytes = recvfrom(pong_socket, buffer, (size_t)dgram_sz, 0, (struct sockaddr *)&ping_addr, &ping_addr_len)) < 0)
 			fail_errno("UDP Pong recv failed");
-		if (received_bytes < dgram_sz)
+		read_ns = trace_now();
+		rx_ns = receive_timestamp(req);
+		if (received_bytes < (req->variable ? MINSIZE : dgram_sz))
 			fail("UDP Pong received fewer bytes than expected");
 		if (sscanf(buffer, "%d\n", &i) != 1)
 			fail("UDP Pong received invalid message");
@@ -101,9 +292,137 @@ void udp_pong(int dgrams_no, int dgram_sz, int pong_socket)
 			if (++resend > MAXUDPRESEND)
 				fail("UDP Pong maximum resend count exceeded");
 		}
-		if (sendto(pong_socket, buffer, (size_t)received_bytes, 0, (struct sockaddr *)&ping_addr, ping_addr_len) < ping_addr_len)
+		reply = prepare_reply(req, buf, i);
+		stamp_reply(req, reply, rx_ns);
+		if (sendto(pong_socket, reply, req->variable ? (size_t)received_bytes : (size_t)req->response_size, 0,
+			   (struct sockaddr *)&ping_addr, ping_addr_len) < 0)
+			fail_errno("UDP Pong failed sending datagram back");
+		if (trace_on) {
+			trace_add(TRACE_WAIT, i, wait_ns, read_ns);
+			trace_mark(TRACE_REPLY, i, read_ns);
+		}
+	}
+	if (counting)
+		perf_test_end(&pc, req);
+}
+
+/*
+ * Loss measurement mode ("loss=1"): never aborts. Every datagram is
+ * answered whatever its sequence number, and the uplink stream is tracked
+ * in constant memory by seq_stats. The test ends when the client writes
+ * "END" on the control connection (or closes it, or stays silent for
+ * PONGSESSIONTOUT seconds); the server then answers with a
+ * "STATS sent=N invalid=N <seq_stats>" line.
+ */
+void udp_pong_loss(const struct pong_request *req, int pong_socket, int control_socket, struct pong_buffers *buf)
+{
+	struct pollfd fds[2];
+	struct seq_stats st;
+	struct timespec arrival;
+	struct sockaddr_storage ping_addr;
+	socklen_t ping_addr_len;
+	unsigned long long sent = 0, invalid = 0;
+	char *buffer = buf->in, *reply, stats_line[256];
+	ssize_t received_bytes;
+	int seq, len;
+	int64_t rx_ns;
+
+	seq_stats_init(&st);
+	fds[0].fd = pong_socket;
+	fds[1].fd = control_socket;
+	fds[0].events = fds[1].events = POLLIN;
+	for (;;) {
+		int ready = poll(fds, 2, PONGSESSIONTOUT * 1000);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready < 0)
+			fail_errno("UDP Pong cannot poll its sockets");
+		if (ready == 0)
+			break;
+		if (fds[0].revents & POLLIN) {
+			for (;;) {
+				ping_addr_len = sizeof ping_addr;
+				received_bytes = recvfrom(pong_socket, buffer, buf->in_size, MSG_DONTWAIT, (struct sockaddr *)&ping_addr, &ping_addr_len);
+				if (received_bytes < 0)
+					break;
+				/* the client's clock is not ours: the offset cancels out in the jitter */
+				if (clock_gettime(CLOCK_TYPE, &arrival) == -1)
+					fail_errno("Pong Server cannot get time");
+				if (received_bytes < LOSS_MINSIZE || sscanf(buffer, "%d\n", &seq) != 1 || seq < 1) {
+					++invalid;
+					continue;
+				}
+				rx_ns = receive_timestamp(req);
+				seq_stats_add(&st, seq, timespec2ns(&arrival) - get_timestamp(buffer + PONG_CLIENT_TS_OFFSET));
+				reply = prepare_reply(req, buf, seq);
+				if (reply != buffer)
+					memcpy(reply + PONG_CLIENT_TS_OFFSET, buffer + PONG_CLIENT_TS_OFFSET, sizeof(int64_t));
+				stamp_reply(req, reply, rx_ns);
+				if (sendto(pong_socket, reply, (size_t)req->response_size, 0, (struct sockaddr *)&ping_addr, ping_addr_len) >= 0)
+					++sent;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				fail_errno("UDP Pong recv failed");
+		}
+		if (fds[1].revents & (POLLIN | POLLHUP | POLLERR))
+			if (read_line(control_socket, stats_line, sizeof stats_line) < 0 || strncmp(stats_line, "END", 3) == 0)
+				break;
+	}
+	len = sprintf(stats_line, "STATS sent=%llu invalid=%llu ", sent, invalid);
+	len += format_seq_stats(stats_line + len, sizeof stats_line - len - 1, &st);
+	strcpy(stats_line + len, "\n");
+	/* the client may be gone already: nothing to do about it */
+	blocking_write_all(control_socket, stats_line, strlen(stats_line));
+}
+
+/*
+ * Only plain echo tests can go through the AF_XDP engine: it neither
+ * writes timestamps nor builds responses of a different size, and tests
+ * tuning the socket options are meant to measure the socket.
+ */
+int xdp_eligible(const struct pong_request *req)
+{
+	return xdp_pong_active() && req->is_udp && !req->timestamps && !req->loss && req->response_size == req->message_size &&
+	       !req->sockopts.set;
+}
+
+/*
+ * UDP test steered to the AF_XDP engine (pong_server -x): the engine
+ * echoes the datagrams and, after the last one, sends a notice to the
+ * socket on the loopback. Datagrams that reach the socket anyway (from
+ * another interface or queue, or fragmented) are echoed from here.
+ */
+void udp_pong_xdp(const struct pong_request *req, int pong_socket, int pong_port, struct pong_buffers *buf)
+{
+	struct pollfd pfd;
+	struct sockaddr_storage ping_addr;
+	socklen_t ping_addr_len;
+	ssize_t received_bytes;
+	int seq;
+
+	pfd.fd = pong_socket;
+	pfd.events = POLLIN;
+	for (;;) {
+		int ready = poll(&pfd, 1, PONGSESSIONTOUT * 1000);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready < 0)
+			fail_errno("UDP Pong cannot poll its socket");
+		if (ready == 0)
+			break;
+		ping_addr_len = sizeof ping_addr;
+		if ((received_bytes = recvfrom(pong_socket, buf->in, buf->in_size, 0, (struct sockaddr *)&ping_addr, &ping_addr_len)) < 0)
+			fail_errno("UDP Pong recv failed");
+		if (xdp_pong_is_notice(buf->in, (size_t)received_bytes, &ping_addr))
+			break;
+		if (received_bytes < (req->variable ? MINSIZE : req->message_size) || sscanf(buf->in, "%d\n", &seq) != 1)
+			fail("UDP Pong received invalid message");
+		if (sendto(pong_socket, buf->in, (size_t)received_bytes, 0, (struct sockaddr *)&ping_addr, ping_addr_len) < 0)
 			fail_errno("UDP Pong failed sending datagram back");
+		if (seq >= req->message_no)
+			break;
 	}
+	xdp_pong_steer(pong_port, 0);
 }
 
 /*** The following function creates a new UDP socket and binds it
@@ -145,62 +464,342 @@ int open_udp_socket(int *pong_port)
 
 			if ((bind_rv = bind(udp_socket, pong_addrinfo->ai_addr, pong_addrinfo->ai_addrlen)) == 0)
 			{
+				freeaddrinfo(pong_addrinfo);
 				*pong_port = port_number;
 				return udp_socket;
 			}
 			if (close(udp_socket))
 				fail_errno("UDP Pong could not close the socket");
 		}
-
-		if (addr == NULL)
-			fail_errno("UDP Pong could not bind socket");
+		freeaddrinfo(pong_addrinfo);
 		/*** TO BE DONE END ***/
+		/* ports taken by concurrent tests are skipped */
 		if (errno != EADDRINUSE)
 			fail_errno("UDP Pong could not bind the socket");
-		if (close(udp_socket))
-			fail_errno("UDP Pong could not close the socket");
 	}
 	fprintf(stderr, "UDP Pong could not find any free ephemeral port\n");
 	return -1;
 }
 
-void serve_pong_udp(int request_socket, int pong_fd, int message_size, int message_no, int pong_port)
+void serve_pong_udp(int request_socket, int pong_fd, const struct pong_request *req, int pong_port, struct pong_buffers *buf)
 {
 	char answer_buf[16];
+	/* set (or cleared) before the client can send anything */
+	xdp_pong_steer(pong_port, xdp_eligible(req) ? req->message_no : 0);
 	sprintf(answer_buf, "OK %d\n", pong_port);
 	if (blocking_write_all(request_socket, answer_buf, strlen(answer_buf)) != strlen(answer_buf))
 		fail_errno("Pong Server UDP cannot send ok message to the client");
+	/* a loss test reports its results on the request socket */
+	if (req->loss)
+		udp_pong_loss(req, pong_fd, request_socket, buf);
 	if (shutdown(request_socket, SHUT_RDWR))
 		fail_errno("Pong Server UDP cannot shutdown socket");
 	if (close(request_socket))
 		fail_errno("Pong Server UDP cannot close request socket");
-	udp_pong(message_no, message_size, pong_fd);
+	if (xdp_eligible(req))
+		udp_pong_xdp(req, pong_fd, pong_port, buf);
+	else if (!req->loss)
+		udp_pong(req, pong_fd, buf);
+}
+
+void send_request_error(int request_socket)
+{
+	const char *const error_msg = "ERROR\n";
+	const size_t len_error_msg = strlen(error_msg);
+	if (blocking_write_all(request_socket, error_msg, len_error_msg) != len_error_msg)
+		fail_errno("Pong server cannot send error message to the client");
 }
 
-void serve_pong_tcp(int pong_fd, FILE *request_stream, size_t message_size, int message_no)
+void serve_pong_tcp(int pong_fd, FILE *request_stream, const struct pong_request *req, struct pong_buffers *buf)
 {
 	const char *const ok_msg = "OK\n";
 	const size_t len_ok_msg = strlen(ok_msg);
 	int nodelay_value = 1;
 	if (setsockopt(pong_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay_value, sizeof nodelay_value))
 		fail_errno("Pong Server TCP cannot set TCP_NODELAY option");
+	if ((*req->congestion && set_congestion(pong_fd, req->congestion)) || apply_sock_options(pong_fd, 1, &req->sockopts)) {
+		send_request_error(pong_fd);
+		return;
+	}
 	if (blocking_write_all(pong_fd, ok_msg, len_ok_msg) != len_ok_msg)
 		fail_errno("Pong Server TCP cannot send ok message to the client");
-	tcp_pong(message_no, message_size, request_stream, pong_fd);
+	tcp_pong(req, request_stream, pong_fd, buf);
 	if (shutdown(pong_fd, SHUT_RDWR))
 		fail_errno("Pong Server TCP cannot shutdown socket");
 }
 
+/*
+ * Parses a "TCP size n" or "UDP size n" request line (the line is modified),
+ * optionally followed by "key=value" options:
+ *   resp=R	answer every message with R bytes instead of echoing it
+ *   ts=1	write server timestamps into every reply (see PONG_TS_OFFSET)
+ *   loss=1	UDP loss measurement (udp_pong_loss()), n is not bounded
+ *   tcpinfo=N	TCP only: sample TCP_INFO every N messages, see tcp_pong()
+ *   cc=ALGO	TCP only: congestion control algorithm of the connection
+ *   so=LIST	socket options of the test socket, see parse_sock_options()
+ *   var=1	echo messages of any size up to size, each starting with a
+ *		"seq size" line (no resp=, ts or loss)
+ * or a "STREAM size up|down" bulk transfer request (serve_stream()), with
+ * time=MS, bytes=N, interval=MS, sendfile=1, cc=ALGO and so=LIST options.
+ * Returns 0 when the request is valid, -1 otherwise.
+ */
+int parse_request(char *request_str, struct pong_request *req)
+{
+	char *strtokr_save, *protocol_str, *size_str, *number_str, *option_str;
+	memset(req, 0, sizeof *req);
+	protocol_str = strtok_r(request_str, " \n", &strtokr_save);
+	if (!protocol_str)
+		return -1;
+	if (strcmp(protocol_str, "TCP") == 0)
+		req->is_tcp = 1;
+	else if (strcmp(protocol_str, "UDP") == 0)
+		req->is_udp = 1;
+	else if (strcmp(protocol_str, "STREAM") == 0)
+		req->is_stream = 1;
+	else
+		return -1;
+	size_str = strtok_r(NULL, " \n", &strtokr_save);
+	if (!size_str || sscanf(size_str, "%d", &req->message_size) != 1)
+		return -1;
+	if (req->message_size < MINSIZE || req->message_size > MAXTCPSIZE || (req->is_udp && req->message_size > MAXUDPSIZE))
+		return -1;
+	number_str = strtok_r(NULL, " \n", &strtokr_save);
+	if (!number_str)
+		return -1;
+	if (req->is_stream) {
+		if (strcmp(number_str, "up") && strcmp(number_str, "down"))
+			return -1;
+		req->stream_up = strcmp(number_str, "up") == 0;
+		req->message_no = 1;
+		req->interval_ms = STREAM_INTERVAL;
+	} else if (sscanf(number_str, "%d", &req->message_no) != 1)
+		return -1;
+	req->response_size = req->message_size;
+	while ((option_str = strtok_r(NULL, " \n", &strtokr_save)) != NULL) {
+		if (sscanf(option_str, "resp=%d", &req->response_size) == 1)
+			continue;
+		if (sscanf(option_str, "ts=%d", &req->timestamps) == 1)
+			continue;
+		if (sscanf(option_str, "loss=%d", &req->loss) == 1)
+			continue;
+		if (req->is_stream && sscanf(option_str, "time=%d", &req->stream_ms) == 1)
+			continue;
+		if (req->is_stream && sscanf(option_str, "bytes=%lld", &req->stream_bytes) == 1)
+			continue;
+		if (req->is_stream && sscanf(option_str, "interval=%d", &req->interval_ms) == 1)
+			continue;
+		if (req->is_stream && sscanf(option_str, "sendfile=%d", &req->sendfile) == 1)
+			continue;
+		if (!req->is_stream && sscanf(option_str, "var=%d", &req->variable) == 1)
+			continue;
+		if (strncmp(option_str, "so=", 3) == 0 && parse_sock_options(option_str + 3, &req->sockopts) == 0)
+			continue;
+		if (req->is_tcp && sscanf(option_str, "tcpinfo=%d", &req->tcpinfo_every) == 1)
+			continue;
+		if (!req->is_udp && strncmp(option_str, "cc=", 3) == 0 && strlen(option_str + 3) < CC_NAME_MAX) {
+			strcpy(req->congestion, option_str + 3);
+			continue;
+		}
+		return -1;
+	}
+	if (req->is_udp && (req->sockopts.set & SOCKOPT_TCP_ONLY))
+		return -1;
+	if (req->is_stream) {
+		if (!req->stream_ms && !req->stream_bytes)
+			req->stream_ms = STREAM_TIME;
+		return req->stream_ms < 0 || req->stream_ms > STREAM_MAXTIME || req->stream_bytes < 0 ||
+		       req->interval_ms < STREAM_MININTERVAL || req->response_size != req->message_size ||
+		       req->timestamps || req->loss ? -1 : 0;
+	}
+	if (req->response_size < MINSIZE || req->response_size > MAXTCPSIZE || (req->is_udp && req->response_size > MAXUDPSIZE))
+		return -1;
+	if (req->timestamps && req->response_size < PONG_TS_MINSIZE)
+		return -1;
+	if (req->variable && (req->timestamps || req->loss || req->response_size != req->message_size))
+		return -1;
+	if (req->loss && (!req->is_udp || req->message_size < LOSS_MINSIZE || req->response_size < LOSS_MINSIZE))
+		return -1;
+	if (req->message_no < 1 || (!req->loss && req->message_no > MAXREPEATS) || req->tcpinfo_every < 0)
+		return -1;
+	return 0;
+}
+
+/*
+ * Bulk transfer: the data flow on a new connection to an ephemeral port,
+ * announced as "OK port" like the UDP port of a ping-pong, so that the
+ * control connection stays free; once the transfer is over the server's
+ * measurements are reported on it (write_stream_report()).
+ */
+void serve_stream(int request_socket, const struct pong_request *req)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof addr;
+	struct pollfd pfd;
+	struct stream_params params;
+	struct stream_stats *st = malloc(sizeof *st);
+	char answer_buf[32];
+	int listen_fd, data_fd;
+
+	if (st == NULL)
+		fail_errno("Pong Server cannot allocate stream statistics");
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if ((listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0 ||
+	    (*req->congestion && set_congestion(listen_fd, req->congestion)) ||
+	    apply_sock_options(listen_fd, 1, &req->sockopts) ||
+	    bind(listen_fd, (struct sockaddr *)&addr, sizeof addr) || listen(listen_fd, 1) ||
+	    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len)) {
+		send_request_error(request_socket);
+		if (listen_fd >= 0)
+			close(listen_fd);
+		free(st);
+		return;
+	}
+	sprintf(answer_buf, "OK %d\n", ntohs(addr.sin_port));
+	if (blocking_write_all(request_socket, answer_buf, strlen(answer_buf)) != strlen(answer_buf))
+		fail_errno("Pong Server cannot send ok message to the client");
+	pfd.fd = listen_fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, PONGRECVTOUT * 1000) != 1)
+		fail("Pong Server: no stream connection from the client");
+	if ((data_fd = accept(listen_fd, NULL, NULL)) < 0)
+		fail_errno("Pong Server cannot accept the stream connection");
+	close(listen_fd);
+
+	params.write_size = (size_t)req->message_size;
+	params.duration_ns = (int64_t)req->stream_ms * 1000000;
+	params.byte_limit = (uint64_t)req->stream_bytes;
+	params.interval_ns = (int64_t)req->interval_ms * 1000000;
+	params.file_fd = -1;
+	params.file_size = req->message_size;
+	if (req->stream_up)
+		stream_receive(data_fd, &params, st);
+	else {
+		if (req->sendfile)
+			params.file_fd = sendfile_source(params.write_size);
+		stream_send(data_fd, &params, st);
+		if (params.file_fd >= 0)
+			close(params.file_fd);
+	}
+	if (close(data_fd))
+		fail_errno("Pong Server cannot close the stream connection");
+	if (write_stream_report(request_socket, st))
+		fail_errno("Pong Server cannot send the stream report");
+	free(st);
+}
+
+/*
+ * Serves a persistent control session: after the "SESSION version"
+ * greeting the client may issue any number of "TCP size n",
+ * "UDP size n" and "STREAM size up|down" tests, one per line, and ends
+ * the session with "QUIT" (or by closing the connection). The message
+ * buffer and the UDP socket are kept from one test to the next.
+ */
+void serve_session(int request_socket, FILE *request_stream, const char *greeting)
+{
+	char *request_str = NULL;
+	char answer_buf[32], session_cc[CC_NAME_MAX];
+	size_t n = 0;
+	struct pong_buffers buf = { NULL, NULL, 0, 0 };
+	int version, udp_fd = -1, udp_port = 0, nodelay_value = 1, udp_tuned = 0;
+	struct timeval receiving_timeout;
+	struct pong_request req;
+	struct sock_options session_sockopts;
+
+	if (sscanf(greeting, "SESSION %d", &version) != 1 || version != SESSION_VERSION) {
+		send_request_error(request_socket);
+		exit(EXIT_FAILURE);
+	}
+	receiving_timeout.tv_sec = PONGSESSIONTOUT;
+	receiving_timeout.tv_usec = 0;
+	if (setsockopt(request_socket, SOL_SOCKET, SO_RCVTIMEO, &receiving_timeout, sizeof receiving_timeout))
+		fail_errno("Cannot set socket timeout");
+	if (setsockopt(request_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay_value, sizeof nodelay_value))
+		fail_errno("Pong Server TCP cannot set TCP_NODELAY option");
+	if (get_congestion(request_socket, session_cc))
+		fail_errno("Pong Server cannot read the congestion control algorithm");
+	sprintf(answer_buf, "OK SESSION %d\n", SESSION_VERSION);
+	if (blocking_write_all(request_socket, answer_buf, strlen(answer_buf)) != strlen(answer_buf))
+		fail_errno("Pong Server cannot send ok message to the client");
+	while (getline(&request_str, &n, request_stream) >= 0) {
+		if (strncmp(request_str, "QUIT", 4) == 0)
+			break;
+		if (parse_request(request_str, &req)) {
+			send_request_error(request_socket);
+			continue;
+		}
+		if (req.is_stream) {
+			serve_stream(request_socket, &req);
+			continue;
+		}
+		reserve_buffers(&buf, &req);
+		if (req.is_udp) {
+			/* socket options apply to one test: a tuned socket is not kept */
+			if (udp_fd >= 0 && (udp_tuned || req.sockopts.set)) {
+				close(udp_fd);
+				udp_fd = -1;
+			}
+			udp_tuned = req.sockopts.set != 0;
+			if (udp_fd < 0 && (udp_fd = open_udp_socket(&udp_port)) < 0) {
+				send_request_error(request_socket);
+				continue;
+			}
+			if (apply_sock_options(udp_fd, 0, &req.sockopts)) {
+				send_request_error(request_socket);
+				continue;
+			}
+			/* stale datagrams (late re-sends) of the previous test */
+			while (recv(udp_fd, buf.in, buf.in_size, MSG_DONTWAIT) >= 0)
+				;
+			xdp_pong_steer(udp_port, xdp_eligible(&req) ? req.message_no : 0);
+			sprintf(answer_buf, "OK %d\n", udp_port);
+		} else if (save_sock_options(request_socket, &req.sockopts, &session_sockopts) ||
+			   (req.sockopts.set & SOCKOPT_BUFFERS) ||
+			   (*req.congestion && set_congestion(request_socket, req.congestion)) ||
+			   apply_sock_options(request_socket, 1, &req.sockopts)) {
+			if (*req.congestion)
+				set_congestion(request_socket, session_cc);
+			apply_sock_options(request_socket, 1, &session_sockopts);
+			send_request_error(request_socket);
+			continue;
+		} else
+			strcpy(answer_buf, "OK\n");
+		if (blocking_write_all(request_socket, answer_buf, strlen(answer_buf)) != strlen(answer_buf))
+			fail_errno("Pong Server cannot send ok message to the client");
+		if (req.is_udp && req.loss)
+			udp_pong_loss(&req, udp_fd, request_socket, &buf);
+		else if (xdp_eligible(&req))
+			udp_pong_xdp(&req, udp_fd, udp_port, &buf);
+		else if (req.is_udp)
+			udp_pong(&req, udp_fd, &buf);
+		else {
+			tcp_pong(&req, request_stream, request_socket, &buf);
+			/* "cc=" and "so=" apply to one test: the next ones get the session's settings */
+			if (*req.congestion && set_congestion(request_socket, session_cc))
+				fail_errno("Pong Server cannot restore the congestion control algorithm");
+			if (apply_sock_options(request_socket, 1, &session_sockopts))
+				fail_errno("Pong Server cannot restore the socket options");
+		}
+	}
+	free(request_str);
+	free(buf.in);
+	free(buf.out);
+	if (udp_fd >= 0)
+		close(udp_fd);
+	fclose(request_stream);
+	exit(EXIT_SUCCESS);
+}
+
 void serve_client(int request_socket, struct sockaddr_in *client_addr)
 {
 	FILE *request_stream = fdopen(request_socket, "r");
-	char *request_str = NULL, *strtokr_save;
-	char *protocol_str, *size_str, *number_str;
+	char *request_str = NULL;
 	size_t n;
-	int message_size, message_no;
+	struct pong_buffers buf = { NULL, NULL, 0, 0 };
 	struct timeval receiving_timeout;
 	char client_addr_as_str[INET_ADDRSTRLEN];
-	int is_tcp = 0, is_udp = 0;
+	struct pong_request req;
 	if (!request_stream)
 		fail_errno("Cannot obtain a stream from the socket");
 	if (inet_ntop(AF_INET, &client_addr->sin_addr, client_addr_as_str, INET_ADDRSTRLEN) == NULL)
@@ -213,62 +812,51 @@ void serve_client(int request_socket, struct sockaddr_in *client_addr)
 	if (getline(&request_str, &n, request_stream) < 0)
 	{
 	send_request_error:
-	{
-		const char *const error_msg = "ERROR\n";
-		const size_t len_error_msg = strlen(error_msg);
-		if (blocking_write_all(request_socket, error_msg, len_error_msg) != len_error_msg)
-			fail_errno("Pong server cannot send error message to the client");
+		send_request_error(request_socket);
 		if (fclose(request_stream))
 			fail_errno("Pong server cannot close request stream");
 		exit(EXIT_FAILURE);
 	}
-	}
-	protocol_str = strtok_r(request_str, " ", &strtokr_save);
-	if (!protocol_str)
+	if (strncmp(request_str, "SESSION", 7) == 0)
+		serve_session(request_socket, request_stream, request_str);
+	if (parse_request(request_str, &req))
 	{
-	free_str_and_send_request_error:
 		free(request_str);
 		goto send_request_error;
 	}
-	if (strcmp(protocol_str, "TCP") == 0)
-		is_tcp = 1;
-	else if (strcmp(protocol_str, "UDP") == 0)
-		is_udp = 1;
-	else
-		goto free_str_and_send_request_error;
-	size_str = strtok_r(NULL, " ", &strtokr_save);
-	if (!size_str)
-		goto free_str_and_send_request_error;
-	if (sscanf(size_str, "%d", &message_size) != 1)
-		goto free_str_and_send_request_error;
-	if (message_size < MINSIZE || message_size > MAXTCPSIZE || (is_udp && message_size > MAXUDPSIZE))
-		goto free_str_and_send_request_error;
-	number_str = strtok_r(NULL, " ", &strtokr_save);
-	if (!number_str)
-		goto free_str_and_send_request_error;
-	if (sscanf(number_str, "%d", &message_no) != 1)
-		goto free_str_and_send_request_error;
-	if (message_no < 1 || message_no > MAXREPEATS)
-		goto free_str_and_send_request_error;
 	free(request_str);
-	if (is_udp)
+	if (req.is_stream)
+	{
+		serve_stream(request_socket, &req);
+		if (fclose(request_stream))
+			fail_errno("Pong server cannot close request stream");
+		exit(EXIT_SUCCESS);
+	}
+	reserve_buffers(&buf, &req);
+	if (req.is_udp)
 	{
 		int pong_port;
 		int pong_fd = open_udp_socket(&pong_port);
-		if (pong_fd < 0)
+		if (pong_fd < 0 || apply_sock_options(pong_fd, 0, &req.sockopts))
 			goto send_request_error;
-		serve_pong_udp(request_socket, pong_fd, message_size, message_no, pong_port);
+		serve_pong_udp(request_socket, pong_fd, &req, pong_port, &buf);
 	}
 	else
 	{
-		assert(is_tcp);
-		serve_pong_tcp(request_socket, request_stream, (size_t)message_size, message_no);
+		assert(req.is_tcp);
+		serve_pong_tcp(request_socket, request_stream, &req, &buf);
 	}
+	free(buf.in);
+	free(buf.out);
 	fclose(request_stream);
 	exit(EXIT_SUCCESS);
 }
 
-void server_loop(int server_socket)
+/*
+ * With trace_dir, every pong child traces its ping-pongs into
+ * trace_dir/pong_PID.json (see trace.c).
+ */
+void server_loop(int server_socket, const char *trace_dir)
 {
 	for (;;)
 	{
@@ -285,8 +873,14 @@ void server_loop(int server_socket)
 		}
 		if ((pid = fork()) < 0)
 			fail_errno("Pong Server could not fork");
-		if (pid == 0)
+		if (pid == 0) {
+			if (trace_dir) {
+				char path[PATH_MAX];
+				snprintf(path, sizeof path, "%s/pong_%d.json", trace_dir, (int)getpid());
+				trace_start(path, "pong_server");
+			}
 			serve_client(request_socket, &client_addr);
+		}
 		if (close(request_socket))
 			fail_errno("Pong Server cannot close request socket");
 	}
@@ -295,10 +889,38 @@ void server_loop(int server_socket)
 int main(int argc, char **argv)
 {
 	struct addrinfo gai_hints, *server_addrinfo;
-	int server_socket, gai_rv;
+	static const char *const usage = "Pong Server incorrect syntax. Use: pong_server [-f] [-x IFNAME[:QUEUE] [-G]] [-T TRACE_DIR] [-p] PORT-NUMBER";
+	int server_socket, gai_rv, opt, fastopen_qlen = 0, xdp_queue = 0, xdp_generic = 0;
+	char *xdp_ifname = NULL, *colon, *trace_dir = NULL;
 	struct sigaction sigchld_action;
+	while ((opt = getopt(argc, argv, "fx:GT:p")) != -1)
+		switch (opt) {
+		case 'f':
+			fastopen_qlen = TFOQUEUELEN;
+			break;
+		case 'x':
+			xdp_ifname = optarg;
+			if ((colon = strchr(optarg, ':')) != NULL) {
+				*colon = '\0';
+				xdp_queue = atoi(colon + 1);
+			}
+			break;
+		case 'G':
+			xdp_generic = 1;
+			break;
+		case 'T':
+			trace_dir = optarg;
+			break;
+		case 'p':
+			count_perf = 1;
+			break;
+		default:
+			fail(usage);
+		}
+	argc -= optind - 1;
+	argv += optind - 1;
 	if (argc != 2)
-		fail("Pong Server incorrect syntax. Use: pong_server PORT-NUMBER");
+		fail(usage);
 	memset(&gai_hints, 0, sizeof gai_hints);
 	gai_hints.ai_family = AF_INET;
 	gai_hints.ai_socktype = SOCK_STREAM;
@@ -325,12 +947,17 @@ int main(int argc, char **argv)
 	if (addr == NULL)
 		fail_errno("Pong Server cannot bind socket");
 
+	if (fastopen_qlen && setsockopt(server_socket, IPPROTO_TCP, TCP_FASTOPEN, &fastopen_qlen, sizeof fastopen_qlen))
+		fail_errno("Pong Server cannot enable TCP Fast Open");
+
 	if (listen(server_socket, LISTENBACKLOG) < 0)
 		fail_errno("Pong Server cannot listen");
 
 	/*** TO BE DONE END ***/
 
 	freeaddrinfo(server_addrinfo);
+	if (xdp_ifname && xdp_pong_start(xdp_ifname, xdp_queue, xdp_generic))
+		fprintf(stderr, "Pong server: no AF_XDP fast path, UDP tests use the socket path\n");
 	fprintf(stderr, "Pong server listening on port %s ...\n", argv[1]);
 	sigchld_action.sa_handler = sigchld_handler;
 	if (sigemptyset(&sigchld_action.sa_mask))
@@ -338,5 +965,5 @@ int main(int argc, char **argv)
 	sigchld_action.sa_flags = SA_NOCLDSTOP;
 	if (sigaction(SIGCHLD, &sigchld_action, NULL))
 		fail_errno("Pong server cannot register SIGCHLD handler");
-	server_loop(server_socket);
+	server_loop(server_socket, trace_dir);
 }
@@ -0,0 +1,415 @@
+/*
+ * probe.c: interfaccia di libreria per eseguire misure ping-pong TCP e
+ *          UDP da un altro programma, senza lanciare tcp_ping o udp_ping:
+ *          le funzioni sono rientranti, non scrivono su stdout e
+ *          restituiscono gli errori invece di terminare il processo, e
+ *          sessioni diverse possono essere usate da thread diversi.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <poll.h>
+#include "pingpong.h"
+
+/* A persistent control session ("SESSION 1") with one Pong server */
+struct probe_session {
+	int control_socket;
+	int udp_socket, udp_port;	/* the server keeps its UDP port for the whole session */
+	struct sockaddr_storage server_addr;
+	socklen_t server_addr_len;
+	int timeout_ms;
+	int broken;		/* a run failed half-way: the control stream is out of step */
+	int64_t last_rtt_ns;
+	char *message, *answer;
+	size_t message_cap, answer_cap;
+	struct latency_hist rtt, residence;
+};
+
+const char *probe_strerror(int err)
+{
+	switch (err) {
+	case PROBE_OK:
+		return "success";
+	case PROBE_ESYS:
+		return "system call failed (see errno)";
+	case PROBE_ERESOLVE:
+		return "cannot resolve the server address";
+	case PROBE_EREFUSED:
+		return "the server refused the request";
+	case PROBE_EPROTO:
+		return "unexpected answer from the server";
+	case PROBE_ETIMEOUT:
+		return "no answer from the server";
+	case PROBE_EINVAL:
+		return "invalid probe parameters";
+	case PROBE_EBROKEN:
+		return "session unusable after a failed run";
+	default:
+		return "unknown probe error";
+	}
+}
+
+static int set_timeouts(int sock, int timeout_ms)
+{
+	struct timeval tv;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) ||
+	    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv))
+		return PROBE_ESYS;
+	return PROBE_OK;
+}
+
+/* A failed read or write on a socket with SO_RCVTIMEO/SO_SNDTIMEO:
+   callers clear errno first, so that a closed connection reads as a
+   protocol error */
+static int io_error(void)
+{
+	return errno == EAGAIN || errno == EWOULDBLOCK ? PROBE_ETIMEOUT : errno ? PROBE_ESYS : PROBE_EPROTO;
+}
+
+/* Like blocking_write_all(), but a connection closed by the server must
+   not raise SIGPIPE in the program embedding the probes */
+static int send_all(int sock, const void *buf, size_t n)
+{
+	const char *p = buf;
+	ssize_t sent;
+	while (n > 0) {
+		if ((sent = send(sock, p, n, MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return io_error();
+		}
+		p += sent;
+		n -= (size_t)sent;
+	}
+	return PROBE_OK;
+}
+
+/* start_session() on top of send_all() */
+static int open_control_session(int control_socket)
+{
+	char request[MAX_REQ], answer[MAX_ANSW];
+	int version, rv;
+	sprintf(request, "SESSION %d\n", SESSION_VERSION);
+	if ((rv = send_all(control_socket, request, strlen(request))) != PROBE_OK)
+		return rv;
+	errno = 0;
+	if (read_line(control_socket, answer, sizeof answer) < 0)
+		return io_error();
+	if (sscanf(answer, "OK SESSION %d", &version) != 1 || version != SESSION_VERSION)
+		return PROBE_EREFUSED;
+	return PROBE_OK;
+}
+
+/*
+ * Connects to the Pong server at host:port and opens a persistent control
+ * session on which any number of probe_run() can follow. No single
+ * operation waits for the server longer than timeout_ms (0 for the
+ * PONGRECVTOUT default). Returns PROBE_OK and sets *session, or a
+ * negative PROBE_E* code.
+ */
+int probe_open(struct probe_session **session, const char *host, const char *port, int timeout_ms)
+{
+	struct addrinfo gai_hints, *server_addrinfo, *addr;
+	struct probe_session *s;
+	int nodelay_value = 1, rv;
+
+	*session = NULL;
+	if (timeout_ms < 0)
+		return PROBE_EINVAL;
+	if ((s = calloc(1, sizeof *s)) == NULL)
+		return PROBE_ESYS;
+	s->control_socket = s->udp_socket = -1;
+	s->timeout_ms = timeout_ms ? timeout_ms : PONGRECVTOUT * 1000;
+	memset(&gai_hints, 0, sizeof gai_hints);
+	gai_hints.ai_family = AF_INET;
+	gai_hints.ai_socktype = SOCK_STREAM;
+	gai_hints.ai_protocol = IPPROTO_TCP;
+	if (getaddrinfo(host, port, &gai_hints, &server_addrinfo)) {
+		free(s);
+		return PROBE_ERESOLVE;
+	}
+	rv = PROBE_ESYS;
+	for (addr = server_addrinfo; addr != NULL; addr = addr->ai_next) {
+		if ((s->control_socket = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol)) < 0)
+			continue;
+		if (set_timeouts(s->control_socket, s->timeout_ms) == PROBE_OK &&
+		    connect(s->control_socket, addr->ai_addr, addr->ai_addrlen) == 0) {
+			memcpy(&s->server_addr, addr->ai_addr, addr->ai_addrlen);
+			s->server_addr_len = addr->ai_addrlen;
+			break;
+		}
+		rv = errno == EINPROGRESS || errno == EAGAIN ? PROBE_ETIMEOUT : PROBE_ESYS;
+		close(s->control_socket);
+		s->control_socket = -1;
+	}
+	freeaddrinfo(server_addrinfo);
+	if (s->control_socket < 0) {
+		free(s);
+		return rv;
+	}
+	if (setsockopt(s->control_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay_value, sizeof nodelay_value))
+		rv = PROBE_ESYS;
+	else
+		rv = open_control_session(s->control_socket);
+	if (rv != PROBE_OK) {
+		s->broken = 1;
+		probe_close(s);
+		return rv;
+	}
+	*session = s;
+	return PROBE_OK;
+}
+
+void probe_close(struct probe_session *s)
+{
+	if (s == NULL)
+		return;
+	if (s->control_socket >= 0) {
+		if (!s->broken)
+			send_all(s->control_socket, "QUIT\n", 5);
+		close(s->control_socket);
+	}
+	if (s->udp_socket >= 0)
+		close(s->udp_socket);
+	free(s->message);
+	free(s->answer);
+	free(s);
+}
+
+static int reserve(char **buf, size_t *cap, size_t size)
+{
+	char *p;
+	if (size <= *cap)
+		return PROBE_OK;
+	if ((p = realloc(*buf, size)) == NULL)
+		return PROBE_ESYS;
+	memset(p + *cap, 0, size - *cap);
+	*buf = p;
+	*cap = size;
+	return PROBE_OK;
+}
+
+/* Connected UDP socket towards the port announced by the server */
+static int udp_socket(struct probe_session *s, int port)
+{
+	struct sockaddr_in addr;
+	if (s->udp_socket >= 0 && s->udp_port == port)
+		return PROBE_OK;
+	if (s->udp_socket >= 0)
+		close(s->udp_socket);
+	memcpy(&addr, &s->server_addr, sizeof addr);
+	addr.sin_port = htons((uint16_t)port);
+	if ((s->udp_socket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+		return PROBE_ESYS;
+	if (connect(s->udp_socket, (struct sockaddr *)&addr, sizeof addr)) {
+		close(s->udp_socket);
+		s->udp_socket = -1;
+		return PROBE_ESYS;
+	}
+	s->udp_port = port;
+	return PROBE_OK;
+}
+
+static int tcp_ping_once(struct probe_session *s, size_t msg_size, size_t resp_size, int64_t *rtt_ns)
+{
+	const int64_t send_ns = now_ns();
+	int rv;
+	if ((rv = send_all(s->control_socket, s->message, msg_size)) != PROBE_OK)
+		return rv;
+	errno = 0;
+	if (read_all(s->control_socket, s->answer, resp_size) != (ssize_t)resp_size)
+		return io_error();
+	*rtt_ns = now_ns() - send_ns;
+	return PROBE_OK;
+}
+
+/*
+ * Same retry policy as udp_ping: the datagram is sent again after
+ * UDP_TIMEOUT without an answer, at most MAXUDPRESEND times; answers to
+ * earlier sequence numbers (late duplicates) are skipped.
+ */
+static int udp_ping_once(struct probe_session *s, int seq, size_t msg_size, size_t resp_size, int64_t *rtt_ns, int *resent)
+{
+	struct pollfd pfd = { s->udp_socket, POLLIN, 0 };
+	int64_t send_ns = 0, deadline = 0, left_ns;
+	int try, ready, answer_seq;
+	ssize_t nr;
+
+	for (try = 0; try <= MAXUDPRESEND;) {
+		if (deadline == 0) {
+			send_ns = now_ns();
+			deadline = send_ns + (int64_t)(UDP_TIMEOUT * 1e6);
+			if (send(s->udp_socket, s->message, msg_size, 0) != (ssize_t)msg_size)
+				return PROBE_ESYS;
+		}
+		if ((left_ns = deadline - now_ns()) <= 0) {
+			deadline = 0;
+			try++;
+			continue;
+		}
+		ready = poll(&pfd, 1, (int)(left_ns / 1000000) + 1);
+		if (ready < 0 && errno != EINTR)
+			return PROBE_ESYS;
+		if (ready <= 0)
+			continue;
+		if ((nr = recv(s->udp_socket, s->answer, resp_size, 0)) < 0)
+			return PROBE_ESYS;
+		if (nr != (ssize_t)resp_size || sscanf(s->answer, "%d\n", &answer_seq) != 1)
+			return PROBE_EPROTO;
+		if (answer_seq == seq) {
+			*rtt_ns = now_ns() - send_ns;
+			*resent += try;
+			return PROBE_OK;
+		}
+	}
+	return PROBE_ETIMEOUT;
+}
+
+/* One "TCP|UDP size n" request of at most MAXREPEATS ping-pongs */
+static int run_chunk(struct probe_session *s, int is_udp, int msg_size, int count, const struct ping_options *opts,
+		     struct probe_result *res)
+{
+	const int resp_size = response_size(msg_size, opts);
+	char request[MAX_REQ], answer[MAX_ANSW];
+	int64_t rtt_ns;
+	int seq, port, rv;
+
+	build_request(request, is_udp ? "UDP" : "TCP", msg_size, count, opts);
+	if ((rv = send_all(s->control_socket, request, strlen(request))) != PROBE_OK)
+		return rv;
+	errno = 0;
+	if (read_line(s->control_socket, answer, sizeof answer) < 0)
+		return io_error();
+	if (strncmp(answer, "ERROR", 5) == 0)
+		return PROBE_EREFUSED;
+	if (is_udp) {
+		if (sscanf(answer, "OK %d", &port) != 1)
+			return PROBE_EPROTO;
+		if ((rv = udp_socket(s, port)) != PROBE_OK)
+			return rv;
+	} else if (strncmp(answer, "OK", 2) != 0)
+		return PROBE_EPROTO;
+
+	for (seq = 1; seq <= count; seq++) {
+		sprintf(s->message, "%d\n", seq);
+		rv = is_udp ? udp_ping_once(s, seq, (size_t)msg_size, (size_t)resp_size, &rtt_ns, &res->resent)
+			    : tcp_ping_once(s, (size_t)msg_size, (size_t)resp_size, &rtt_ns);
+		if (rv != PROBE_OK)
+			return rv;
+		s->last_rtt_ns = rtt_ns;
+		hist_add(&s->rtt, rtt_ns);
+		if (opts->timestamps)
+			hist_add(&s->residence, get_timestamp(s->answer + PONG_TS_OFFSET + sizeof(int64_t)) -
+				 get_timestamp(s->answer + PONG_TS_OFFSET));
+	}
+	return PROBE_OK;
+}
+
+static int prepare_run(struct probe_session *s, int is_udp, int msg_size, const struct ping_options *opts)
+{
+	const int max_size = is_udp ? MAXUDPSIZE : MAXTCPSIZE;
+	const int resp_size = response_size(msg_size, opts);
+	if (s->broken)
+		return PROBE_EBROKEN;
+	if (msg_size < MINSIZE || msg_size > max_size || resp_size < MINSIZE || resp_size > max_size ||
+	    opts->loss || opts->stream || opts->tcpinfo_every || opts->variable || opts->sockopt_spec ||
+	    (opts->timestamps && resp_size < PONG_TS_MINSIZE))
+		return PROBE_EINVAL;
+	if (reserve(&s->message, &s->message_cap, (size_t)msg_size) || reserve(&s->answer, &s->answer_cap, (size_t)resp_size))
+		return PROBE_ESYS;
+	return PROBE_OK;
+}
+
+/*
+ * Runs count ping-pongs of msg_size bytes over TCP, or UDP if is_udp is
+ * set, with the response size and timestamp options of opts (loss and
+ * stream tests, TCP_INFO sampling, replays and socket options are not
+ * supported), and fills *res. Runs longer than MAXREPEATS are split into
+ * several requests. Percentiles come from a latency_hist, within 1% of
+ * the exact values, so count is not bounded.
+ * Returns PROBE_OK or a negative PROBE_E* code; after a failure other
+ * than PROBE_EINVAL and PROBE_EREFUSED the session can only be closed.
+ * A session must not be used by two threads at the same time.
+ */
+int probe_run(struct probe_session *s, int is_udp, int msg_size, int count, const struct ping_options *opts,
+	      struct probe_result *res)
+{
+	static const struct ping_options no_options;
+	const int resp_size = response_size(msg_size, opts ? opts : &no_options);
+	int done, chunk, rv;
+
+	memset(res, 0, sizeof *res);
+	if (opts == NULL)
+		opts = &no_options;
+	if (count < 1)
+		return PROBE_EINVAL;
+	if ((rv = prepare_run(s, is_udp, msg_size, opts)) != PROBE_OK)
+		return rv;
+	hist_init(&s->rtt);
+	hist_init(&s->residence);
+
+	for (done = 0; done < count && rv == PROBE_OK; done += chunk) {
+		chunk = count - done < MAXREPEATS ? count - done : MAXREPEATS;
+		rv = run_chunk(s, is_udp, msg_size, chunk, opts, res);
+	}
+	if (rv != PROBE_OK) {
+		if (rv != PROBE_EREFUSED)
+			s->broken = 1;
+		return rv;
+	}
+
+	res->count = count;
+	res->min_ms = s->rtt.min_ns / 1e6;
+	res->max_ms = s->rtt.max_ns / 1e6;
+	res->mean_ms = s->rtt.sum_ns / (double)s->rtt.count / 1e6;
+	res->p50_ms = hist_percentile(&s->rtt, 50) / 1e6;
+	res->p90_ms = hist_percentile(&s->rtt, 90) / 1e6;
+	res->p99_ms = hist_percentile(&s->rtt, 99) / 1e6;
+	res->p999_ms = hist_percentile(&s->rtt, 99.9) / 1e6;
+	res->throughput = (msg_size + resp_size) / res->p50_ms;
+	if (opts->timestamps) {
+		res->residence_p50_ms = hist_percentile(&s->residence, 50) / 1e6;
+		res->residence_p99_ms = hist_percentile(&s->residence, 99) / 1e6;
+	}
+	return PROBE_OK;
+}
+
+/*
+ * A single ping-pong, its own "TCP|UDP size 1" request, for callers that
+ * pace their measurements (see pingpong_monitor.c): sets *rtt_ms and
+ * returns like probe_run(), whose statistics it leaves alone.
+ */
+int probe_ping(struct probe_session *s, int is_udp, int msg_size, const struct ping_options *opts, double *rtt_ms)
+{
+	static const struct ping_options no_options;
+	struct probe_result unused;
+	int rv;
+
+	if (opts == NULL)
+		opts = &no_options;
+	if ((rv = prepare_run(s, is_udp, msg_size, opts)) != PROBE_OK)
+		return rv;
+	if ((rv = run_chunk(s, is_udp, msg_size, 1, opts, &unused)) != PROBE_OK) {
+		if (rv != PROBE_EREFUSED)
+			s->broken = 1;
+		return rv;
+	}
+	*rtt_ms = s->last_rtt_ns / 1e6;
+	return PROBE_OK;
+}
@@ -90,3 +90,27 @@ ssize_t nonblocking_write_all(int fd, const void *ptr, size_t n)
 	return n - n_left;
 }
 
+
+/* Reads a '\n'-terminated control line one byte at a time, so that no
+   byte following the line is consumed; the line is NUL-terminated and
+   truncated to n - 1 characters. Returns its length, or -1 on error or
+   if the connection was closed before the end of the line. */
+
+ssize_t read_line(int fd, char *buf, size_t n)
+{
+	size_t len = 0;
+	char c;
+	for (;;) {
+		ssize_t n_read = read(fd, &c, 1);
+		if (n_read < 0 && errno == EINTR)
+			continue;
+		if (n_read <= 0)
+			return -1;
+		if (len + 1 < n)
+			buf[len++] = c;
+		if (c == '\n')
+			break;
+	}
+	buf[len] = 0;
+	return (ssize_t)len;
+}
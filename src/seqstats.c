@@ -0,0 +1,110 @@
+/*
+ * seqstats.c: conteggio di perdite, duplicati, riordinamenti e jitter
+ *             dei datagrammi UDP numerati
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "pingpong.h"
+
+/*
+ * Tracks a stream of sequence numbers in constant memory: a bitmap of the
+ * last SEQ_WINDOW sequence numbers below the highest one tells new
+ * arrivals from duplicates; anything older than the window is only
+ * counted as "too late". The interarrival jitter follows RFC 3550 (6.4.1):
+ * J += (|D| - J) / 16, D being the difference of the transit times of two
+ * consecutive arrivals. Transit times may include any constant clock
+ * offset, which cancels out in D.
+ */
+
+void seq_stats_init(struct seq_stats *st)
+{
+	memset(st, 0, sizeof *st);
+}
+
+static int seq_seen(const struct seq_stats *st, int64_t seq)
+{
+	return (st->seen[(seq % SEQ_WINDOW) / 64] >> (seq % 64)) & 1;
+}
+
+static void seq_mark(struct seq_stats *st, int64_t seq, int value)
+{
+	uint64_t bit = (uint64_t)1 << (seq % 64);
+	if (value)
+		st->seen[(seq % SEQ_WINDOW) / 64] |= bit;
+	else
+		st->seen[(seq % SEQ_WINDOW) / 64] &= ~bit;
+}
+
+void seq_stats_add(struct seq_stats *st, int64_t seq, int64_t transit_ns)
+{
+	int64_t s;
+	if (seq > st->highest) {
+		if (seq - st->highest >= SEQ_WINDOW)
+			memset(st->seen, 0, sizeof st->seen);
+		else
+			for (s = st->highest + 1; s < seq; s++)
+				seq_mark(st, s, 0);
+		seq_mark(st, seq, 1);
+		st->highest = seq;
+	} else if (st->highest - seq >= SEQ_WINDOW) {
+		st->too_late++;
+		return;
+	} else if (seq_seen(st, seq)) {
+		st->duplicates++;
+		return;
+	} else {
+		seq_mark(st, seq, 1);
+		st->reordered++;
+		if (st->highest - seq > st->max_reorder)
+			st->max_reorder = st->highest - seq;
+	}
+	st->received++;
+	if (st->received > 1) {
+		int64_t d = transit_ns - st->last_transit;
+		st->jitter_ns += ((double)(d < 0 ? -d : d) - st->jitter_ns) / 16.0;
+	}
+	st->last_transit = transit_ns;
+}
+
+/* one line "key=value ..." summary, also used on the control connection */
+int format_seq_stats(char *buf, size_t n, const struct seq_stats *st)
+{
+	return snprintf(buf, n, "received=%llu duplicates=%llu reordered=%llu max_reorder=%lld too_late=%llu highest=%lld jitter_ns=%.0f",
+			(unsigned long long)st->received, (unsigned long long)st->duplicates,
+			(unsigned long long)st->reordered, (long long)st->max_reorder,
+			(unsigned long long)st->too_late, (long long)st->highest, st->jitter_ns);
+}
+
+int parse_seq_stats(const char *buf, struct seq_stats *st)
+{
+	unsigned long long received, duplicates, reordered, too_late;
+	long long max_reorder, highest;
+	seq_stats_init(st);
+	if (sscanf(buf, "received=%llu duplicates=%llu reordered=%llu max_reorder=%lld too_late=%llu highest=%lld jitter_ns=%lf",
+		   &received, &duplicates, &reordered, &max_reorder, &too_late, &highest, &st->jitter_ns) != 7)
+		return -1;
+	st->received = received;
+	st->duplicates = duplicates;
+	st->reordered = reordered;
+	st->max_reorder = max_reorder;
+	st->too_late = too_late;
+	st->highest = highest;
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * session.c: funzioni ausiliarie per il protocollo di controllo a sessione
+ *            persistente ("SESSION 1") del ping-pong
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "pingpong.h"
+
+/*
+ * Parses a comma separated list of message sizes ("64" or "32,64,128")
+ * into sizes[max_sizes]. Returns the number of sizes, or -1 if the list
+ * is malformed or too long.
+ */
+int parse_size_list(const char *arg, int sizes[], int max_sizes)
+{
+	int n_sizes = 0, consumed;
+	while (*arg) {
+		if (n_sizes == max_sizes || sscanf(arg, "%d%n", &sizes[n_sizes], &consumed) != 1)
+			return -1;
+		++n_sizes;
+		arg += consumed;
+		if (*arg == ',')
+			++arg;
+		else if (*arg)
+			return -1;
+	}
+	return n_sizes > 0 ? n_sizes : -1;
+}
+
+int response_size(int msg_size, const struct ping_options *opts)
+{
+	return opts->resp_size ? opts->resp_size : msg_size;
+}
+
+/*
+ * Writes into request[MAX_REQ] the "TCP size n" or "UDP size n" line for
+ * the given options; options equal to their default are left out, so that
+ * servers not knowing them still accept plain requests.
+ */
+void build_request(char *request, const char *protocol, int msg_size, int norep, const struct ping_options *opts)
+{
+	int len = sprintf(request, "%s %d %d", protocol, msg_size, norep);
+	if (opts->resp_size && opts->resp_size != msg_size)
+		len += sprintf(request + len, " resp=%d", opts->resp_size);
+	if (opts->timestamps)
+		len += sprintf(request + len, " ts=1");
+	if (opts->loss)
+		len += sprintf(request + len, " loss=1");
+	if (opts->variable)
+		len += sprintf(request + len, " var=1");
+	if (opts->tcpinfo_every)
+		len += sprintf(request + len, " tcpinfo=%d", opts->tcpinfo_every);
+	if (opts->congestion)
+		len += sprintf(request + len, " cc=%s", opts->congestion);
+	if (opts->sockopt_spec)
+		len += sprintf(request + len, " so=%s", opts->sockopt_spec);
+	strcpy(request + len, "\n");
+}
+
+/*
+ * "STREAM size up|down" request of a bulk transfer, with its limits:
+ * time=MS, bytes=N (the sender stops at the first one reached),
+ * interval=MS between throughput reports, sendfile=1 for the sender,
+ * cc=ALGO for the congestion control and so=LIST for the socket options of
+ * the data connection.
+ */
+void build_stream_request(char *request, int write_size, const struct ping_options *opts)
+{
+	int len = sprintf(request, "STREAM %d %s", write_size, opts->stream == STREAM_UP ? "up" : "down");
+	if (opts->stream_ms)
+		len += sprintf(request + len, " time=%d", opts->stream_ms);
+	if (opts->stream_bytes)
+		len += sprintf(request + len, " bytes=%lld", opts->stream_bytes);
+	if (opts->report_ms != STREAM_INTERVAL)
+		len += sprintf(request + len, " interval=%d", opts->report_ms);
+	if (opts->sendfile && opts->stream == STREAM_DOWN)
+		len += sprintf(request + len, " sendfile=1");
+	if (opts->congestion)
+		len += sprintf(request + len, " cc=%s", opts->congestion);
+	if (opts->sockopt_spec)
+		len += sprintf(request + len, " so=%s", opts->sockopt_spec);
+	strcpy(request + len, "\n");
+}
+
+/*
+ * Turns a freshly connected control socket into a persistent session:
+ * every subsequent "TCP size n" / "UDP size n" request is served on the
+ * same connection. Returns 0 on success, -1 if the server refused.
+ */
+int start_session(int control_socket)
+{
+	char request[MAX_REQ], answer[MAX_ANSW];
+	int version;
+	sprintf(request, "SESSION %d\n", SESSION_VERSION);
+	if (blocking_write_all(control_socket, request, strlen(request)) != strlen(request))
+		return -1;
+	if (read_line(control_socket, answer, sizeof answer) < 0)
+		return -1;
+	if (sscanf(answer, "OK SESSION %d", &version) != 1 || version != SESSION_VERSION)
+		return -1;
+	return 0;
+}
+
+void end_session(int control_socket)
+{
+	const char *const quit_msg = "QUIT\n";
+	blocking_write_all(control_socket, quit_msg, strlen(quit_msg));
+}
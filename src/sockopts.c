@@ -0,0 +1,135 @@
+/*
+ * sockopts.c: opzioni dei socket scelte per ogni prova (--sockopt) e
+ *             applicate da entrambi gli estremi attraverso la richiesta
+ *             di controllo: TCP_NODELAY, TCP_QUICKACK, TCP_CORK,
+ *             SO_SNDBUF, SO_RCVBUF, SO_BUSY_POLL e IP_TOS.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "pingpong.h"
+
+/*
+ * Parses a comma-separated list of
+ *   nodelay[=0|1] quickack[=0|1] cork[=0|1]	(TCP only)
+ *   sndbuf=BYTES rcvbuf=BYTES busypoll=US tos=N
+ * into *so. Returns 0, or -1 if the list is not valid.
+ */
+int parse_sock_options(const char *spec, struct sock_options *so)
+{
+	char item[32];
+	const char *p = spec;
+	size_t len;
+	int value;
+
+	memset(so, 0, sizeof *so);
+	if (strlen(spec) > SOCKOPT_SPEC_MAX)
+		return -1;
+	while (*p) {
+		len = strcspn(p, ",");
+		if (len == 0 || len >= sizeof item)
+			return -1;
+		memcpy(item, p, len);
+		item[len] = 0;
+		p += len + (p[len] == ',');
+		value = 1;
+		if (strcmp(item, "nodelay") == 0 || sscanf(item, "nodelay=%d", &value) == 1) {
+			so->set |= SOCKOPT_NODELAY;
+			so->nodelay = value != 0;
+		} else if (strcmp(item, "quickack") == 0 || sscanf(item, "quickack=%d", &value) == 1) {
+			so->set |= SOCKOPT_QUICKACK;
+			so->quickack = value != 0;
+		} else if (strcmp(item, "cork") == 0 || sscanf(item, "cork=%d", &value) == 1) {
+			so->set |= SOCKOPT_CORK;
+			so->cork = value != 0;
+		} else if (sscanf(item, "sndbuf=%d", &so->sndbuf) == 1 && so->sndbuf > 0)
+			so->set |= SOCKOPT_SNDBUF;
+		else if (sscanf(item, "rcvbuf=%d", &so->rcvbuf) == 1 && so->rcvbuf > 0)
+			so->set |= SOCKOPT_RCVBUF;
+		else if (sscanf(item, "busypoll=%d", &so->busy_poll_us) == 1 && so->busy_poll_us >= 0)
+			so->set |= SOCKOPT_BUSYPOLL;
+		else if (sscanf(item, "tos=%i", &so->tos) == 1 && so->tos >= 0 && so->tos <= 255)
+			so->set |= SOCKOPT_TOS;
+		else
+			return -1;
+	}
+	return 0;
+}
+
+static int set_int(int sock, int level, int name, int value)
+{
+	return setsockopt(sock, level, name, &value, sizeof value);
+}
+
+static int get_int(int sock, int level, int name, int *value)
+{
+	socklen_t len = sizeof *value;
+	return getsockopt(sock, level, name, value, &len);
+}
+
+/*
+ * Sets the options of *so on sock, a TCP socket if is_tcp; the buffer
+ * sizes are best set before connect(), where they also choose the window
+ * scale. TCP_CORK is not set here but around every message (see
+ * sock_cork()). Returns 0, or -1 with errno set.
+ */
+int apply_sock_options(int sock, int is_tcp, const struct sock_options *so)
+{
+	if ((so->set & SOCKOPT_TCP_ONLY) && !is_tcp) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (((so->set & SOCKOPT_NODELAY) && set_int(sock, IPPROTO_TCP, TCP_NODELAY, so->nodelay)) ||
+	    ((so->set & SOCKOPT_QUICKACK) && set_int(sock, IPPROTO_TCP, TCP_QUICKACK, so->quickack)) ||
+	    ((so->set & SOCKOPT_SNDBUF) && set_int(sock, SOL_SOCKET, SO_SNDBUF, so->sndbuf)) ||
+	    ((so->set & SOCKOPT_RCVBUF) && set_int(sock, SOL_SOCKET, SO_RCVBUF, so->rcvbuf)) ||
+	    ((so->set & SOCKOPT_BUSYPOLL) && set_int(sock, SOL_SOCKET, SO_BUSY_POLL, so->busy_poll_us)) ||
+	    ((so->set & SOCKOPT_TOS) && set_int(sock, IPPROTO_IP, IP_TOS, so->tos)))
+		return -1;
+	return 0;
+}
+
+/*
+ * Reads into *saved the current values of the options of *so that stay
+ * on a socket after a test, so that apply_sock_options(sock, 1, saved)
+ * puts them back: TCP_QUICKACK and TCP_CORK do not outlast a message
+ * (see sock_quickack() and sock_cork()), the buffer sizes cannot be
+ * restored (setting them stops their autotuning) and are not saved.
+ * Returns 0, or -1 with errno set and nothing to restore in *saved.
+ */
+int save_sock_options(int sock, const struct sock_options *so, struct sock_options *saved)
+{
+	memset(saved, 0, sizeof *saved);
+	if (((so->set & SOCKOPT_NODELAY) && get_int(sock, IPPROTO_TCP, TCP_NODELAY, &saved->nodelay)) ||
+	    ((so->set & SOCKOPT_BUSYPOLL) && get_int(sock, SOL_SOCKET, SO_BUSY_POLL, &saved->busy_poll_us)) ||
+	    ((so->set & SOCKOPT_TOS) && get_int(sock, IPPROTO_IP, IP_TOS, &saved->tos)))
+		return -1;
+	saved->set = so->set & (SOCKOPT_NODELAY | SOCKOPT_BUSYPOLL | SOCKOPT_TOS);
+	return 0;
+}
+
+/* With "cork" every message is written between TCP_CORK on and off */
+int sock_cork(int sock, const struct sock_options *so, int on)
+{
+	return so->cork ? set_int(sock, IPPROTO_TCP, TCP_CORK, on) : 0;
+}
+
+/* TCP_QUICKACK does not stick: it is set again after every message read */
+int sock_quickack(int sock, const struct sock_options *so)
+{
+	return so->quickack ? set_int(sock, IPPROTO_TCP, TCP_QUICKACK, 1) : 0;
+}
@@ -48,8 +48,13 @@ int double_cmp(const void *p1, const void *p2)
 	return 0;
 }
 
+/*
+ * msg_sz is the size of the messages sent by the client, resp_sz the
+ * size of the answers; throughput is reported for each direction and,
+ * in the last line, for both together.
+ */
 void print_statistics(FILE * outf, const char *name, int repeats,
-		      double rtt[repeats], int msg_sz, double resolution)
+		      double rtt[repeats], int msg_sz, int resp_sz, double resolution)
 {
 	const int N_HISTOGRAM_ITEMS = 21;
 	int median = repeats / 2;
@@ -87,16 +92,137 @@ void print_statistics(FILE * outf, const char *name, int repeats,
 		histogram[j]++;
 	}
 	var /= (double)(repeats - 1);
-	fprintf(outf, "\n%s Statistics over %d repetitions of %d byte messages\n\n", name, repeats, msg_sz);
+	if (resp_sz == msg_sz)
+		fprintf(outf, "\n%s Statistics over %d repetitions of %d byte messages\n\n", name, repeats, msg_sz);
+	else
+		fprintf(outf, "\n%s Statistics over %d repetitions of %d byte messages with %d byte responses\n\n", name, repeats, msg_sz, resp_sz);
 	fprintf(outf, "RTT : percentile 10: %lg, median: %lg, percentile 90: %lg, average: %lg, variance: %lg\n\n", rtt[p10], rtt[median], rtt[p90], mean, var);
+	if (rtt[median] > 0.0 && mean > 0.0)
+		fprintf(outf, "Per-direction rate : request median %lg KB/s, average %lg KB/s; response median %lg KB/s, average %lg KB/s\n\n",
+			(double)msg_sz / rtt[median], (double)msg_sz / mean, (double)resp_sz / rtt[median], (double)resp_sz / mean);
 	fprintf(outf, "RTT histogram:\n");
 	for (j = 0, ns = h_min; j < N_HISTOGRAM_ITEMS; j++, ns += h_incr)
 		fprintf(outf, "%lg %d\n", ns, histogram[j]);
 	fprintf(outf, "\n");
 	if (rtt[median] > 0.0)
-		fprintf(outf,"   median Throughput : %lg KB/s", 2.0*(double)(msg_sz)/rtt[median]);
+		fprintf(outf,"   median Throughput : %lg KB/s", (double)(msg_sz + resp_sz)/rtt[median]);
 	if (mean > 0.0)
-		fprintf(outf, "   overall Throughput : %lg KB/s", 2.0 * (double)(msg_sz) / mean);
+		fprintf(outf, "   overall Throughput : %lg KB/s", (double)(msg_sz + resp_sz) / mean);
 	fprintf(outf, "\n\n");
 }
 
+/*
+ * Prints a one-line percentile summary of n samples (sorted in place).
+ */
+void print_percentiles(FILE * outf, const char *label, int n, double v[n])
+{
+	double mean = 0.0;
+	int i;
+
+	if (n < 1) {
+		fprintf(outf, "%s: no samples\n", label);
+		return;
+	}
+	qsort(v, (size_t)n, sizeof(double), double_cmp);
+	for (i = 0; i < n; i++)
+		mean += (v[i] - mean) / (double)(i + 1);
+	fprintf(outf, "%s: min %lg, percentile 10: %lg, median: %lg, percentile 90: %lg, percentile 99: %lg, max %lg, average: %lg\n",
+		label, v[0], v[n / 10], v[n / 2], v[(9 * n) / 10], v[(99 * n) / 100], v[n - 1], mean);
+}
+
+/*
+ * Harness self-test: runs the client side of a repetition (the client's
+ * own do_ping(), passed as ping, and the store of the sample into the
+ * deferred log) against a null peer, the other end of a socketpair() of
+ * sock_type whose echo is already queued before the message is sent, so
+ * that nothing but the harness is timed. Messages and answers longer
+ * than HARNESS_MAXSIZE are cut to fit the socket buffers.
+ * Stores in *window_ms the median RTT measured by ping, the time that
+ * ends up inside the measured RTT window, and in *iteration_ms the
+ * median cost of a whole repetition; RTTs close to these values cannot
+ * be told apart from harness noise.
+ */
+void measure_harness_overhead(int sock_type, size_t msg_size, size_t resp_size, int repeats, harness_ping ping,
+			      double *window_ms, double *iteration_ms)
+{
+	const size_t msg_sz = msg_size < HARNESS_MAXSIZE ? msg_size : HARNESS_MAXSIZE;
+	const size_t resp_sz = resp_size < HARNESS_MAXSIZE ? resp_size : HARNESS_MAXSIZE;
+	char message[msg_sz], answer[resp_sz], peer[msg_sz > resp_sz ? msg_sz : resp_sz];
+	double rtt[repeats], iteration[repeats];
+	int64_t send_ns[repeats];
+	struct timespec start_time, end_time;
+	int sv[2], rep, tracing = trace_on;
+
+	trace_on = 0;	/* the self-test does not belong in --trace */
+	if (socketpair(AF_UNIX, sock_type, 0, sv))
+		fail_errno("Harness self-test cannot create a socket pair");
+	if (sock_type == SOCK_DGRAM && fcntl(sv[0], F_SETFL, O_NONBLOCK) == -1)
+		fail_errno("Harness self-test cannot set the socket to non-blocking");
+	memset(message, 0, msg_sz);
+	memset(peer, 0, sizeof peer);
+	for (rep = 1; rep <= repeats; ++rep) {
+		/* null peer: the echo is waiting before the message leaves */
+		if (blocking_write_all(sv[1], peer, resp_sz) != resp_sz)
+			fail_errno("Harness self-test cannot queue the echo");
+		if (clock_gettime(CLOCK_TYPE, &start_time) == -1)
+			fail_errno("Error getting time");
+		rtt[rep - 1] = ping(msg_sz, rep, message, sv[0], resp_sz, answer, &send_ns[rep - 1]);
+		if (clock_gettime(CLOCK_TYPE, &end_time) == -1)
+			fail_errno("Error getting time");
+		iteration[rep - 1] = timespec_delta2milliseconds(&end_time, &start_time);
+		if (read_all(sv[1], peer, msg_sz) != msg_sz)
+			fail_errno("Harness self-test cannot read the message");
+	}
+	close(sv[0]);
+	close(sv[1]);
+	trace_on = tracing;
+	qsort(rtt, (size_t)repeats, sizeof(double), double_cmp);
+	qsort(iteration, (size_t)repeats, sizeof(double), double_cmp);
+	*window_ms = rtt[repeats / 2];
+	*iteration_ms = iteration[repeats / 2];
+}
+
+void print_harness_overhead(FILE * outf, int sock_type, size_t msg_size, size_t resp_size, int repeats, harness_ping ping)
+{
+	double window_ms, iteration_ms;
+
+	measure_harness_overhead(sock_type, msg_size, resp_size, repeats, ping, &window_ms, &iteration_ms);
+	fprintf(outf, "\n ... harness self-test (null peer, %d repetitions): %lg ms inside the RTT window, %lg ms per repetition\n",
+		repeats, window_ms, iteration_ms);
+}
+
+
+/*
+ * Splits every RTT sample with the server timestamps of its reply (ts=1):
+ * the server residence time is always meaningful; uplink and downlink
+ * one-way delays only when the two clocks are synchronized, otherwise the
+ * network share of the RTT (RTT minus residence) is reported instead.
+ * send_ns are CLOCK_TYPE readings, clock_offset converts them to
+ * TS_CLOCK_TYPE (see clock_offset_ns()).
+ */
+void print_breakdown(FILE * outf, const char *name, int repeats, const double rtt[repeats],
+		     const int64_t send_ns[repeats], const int64_t server_rx_ns[repeats],
+		     const int64_t server_tx_ns[repeats], int64_t clock_offset, int synced_clocks)
+{
+	double residence[repeats], uplink[repeats], downlink[repeats];
+	int i;
+
+	for (i = 0; i < repeats; i++) {
+		int64_t client_tx = send_ns[i] + clock_offset;
+		int64_t client_rx = client_tx + (int64_t)(rtt[i] * 1e6);
+		residence[i] = (double)(server_tx_ns[i] - server_rx_ns[i]) / 1e6;
+		uplink[i] = (double)(server_rx_ns[i] - client_tx) / 1e6;
+		downlink[i] = (double)(client_rx - server_tx_ns[i]) / 1e6;
+	}
+	fprintf(outf, "\n%s RTT breakdown from server timestamps (ms)\n", name);
+	print_percentiles(outf, "  server residence", repeats, residence);
+	if (synced_clocks) {
+		print_percentiles(outf, "  uplink one-way delay", repeats, uplink);
+		print_percentiles(outf, "  downlink one-way delay", repeats, downlink);
+	} else {
+		/* uplink + downlink does not depend on the clock offset */
+		for (i = 0; i < repeats; i++)
+			uplink[i] += downlink[i];
+		print_percentiles(outf, "  network (RTT - residence)", repeats, uplink);
+	}
+}
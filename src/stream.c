@@ -0,0 +1,300 @@
+/*
+ * stream.c: trasferimento unidirezionale di dati (modalita` "STREAM") per
+ *           misurare la banda sostenuta di una connessione TCP, comune a
+ *           client e server: invio con write() o sendfile(), ricezione,
+ *           statistiche per intervallo, ritrasmissioni e uso della CPU.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include "pingpong.h"
+
+static int64_t timeval2ns(const struct timeval *tv)
+{
+	return (int64_t)tv->tv_sec * 1000000000 + (int64_t)tv->tv_usec * 1000;
+}
+
+static uint32_t total_retrans(int sock)
+{
+	struct tcp_info info;
+	socklen_t len = sizeof info;
+	if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len))
+		return 0;
+	return info.tcpi_total_retrans;
+}
+
+static void close_interval(struct stream_stats *st, int64_t end_ns, uint64_t *interval_bytes, uint32_t retrans)
+{
+	if (st->n_intervals < MAXINTERVALS) {
+		struct stream_interval *iv = &st->intervals[st->n_intervals++];
+		iv->end_ns = end_ns;
+		iv->bytes = *interval_bytes;
+		iv->retrans = retrans;
+	}
+	*interval_bytes = 0;
+}
+
+static void begin_usage(struct rusage *ru)
+{
+	if (getrusage(RUSAGE_SELF, ru))
+		fail_errno("Cannot get resource usage");
+}
+
+static void end_usage(const struct rusage *start, struct stream_stats *st)
+{
+	struct rusage ru;
+	begin_usage(&ru);
+	st->cpu_user_ns = timeval2ns(&ru.ru_utime) - timeval2ns(&start->ru_utime);
+	st->cpu_sys_ns = timeval2ns(&ru.ru_stime) - timeval2ns(&start->ru_stime);
+}
+
+/*
+ * A file of size bytes, all zero and only in memory, to stream with
+ * sendfile() when no other file is given. Returns its descriptor.
+ */
+int sendfile_source(size_t size)
+{
+	int fd = memfd_create("pingpong-stream", 0);
+	if (fd < 0)
+		fail_errno("Cannot create the sendfile() source");
+	if (ftruncate(fd, (off_t)size))
+		fail_errno("Cannot size the sendfile() source");
+	return fd;
+}
+
+/*
+ * Streams data on sock until p->duration_ns has elapsed or p->byte_limit
+ * bytes have been sent, whichever comes first, with write()s of
+ * p->write_size bytes or, if p->file_fd >= 0, with sendfile() from that
+ * file (from its start again when its end is reached). Returns 0, or -1
+ * if the connection failed before the end.
+ */
+int stream_send(int sock, const struct stream_params *p, struct stream_stats *st)
+{
+	char *buf = NULL;
+	uint64_t interval_bytes = 0;
+	int64_t start, now, next_report;
+	off_t offset = 0;
+	struct rusage ru;
+	ssize_t n;
+	size_t chunk;
+	int rv = 0;
+
+	memset(st, 0, sizeof *st);
+	if (p->file_fd < 0 && (buf = calloc(1, p->write_size)) == NULL)
+		fail_errno("Cannot allocate the stream buffer");
+	begin_usage(&ru);
+	start = now = now_ns();
+	next_report = start + p->interval_ns;
+	/*** no stdio inside the measurement loop ***/
+	for (;;) {
+		if ((p->duration_ns && now - start >= p->duration_ns) || (p->byte_limit && st->bytes >= p->byte_limit))
+			break;
+		chunk = p->write_size;
+		if (p->byte_limit && p->byte_limit - st->bytes < chunk)
+			chunk = (size_t)(p->byte_limit - st->bytes);
+		if (p->file_fd >= 0) {
+			if (offset >= p->file_size)
+				offset = 0;
+			if ((off_t)chunk > p->file_size - offset)
+				chunk = (size_t)(p->file_size - offset);
+			n = sendfile(sock, p->file_fd, &offset, chunk);
+		} else
+			n = write(sock, buf, chunk);
+		now = now_ns();
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			rv = -1;
+			break;
+		}
+		st->bytes += (uint64_t)n;
+		interval_bytes += (uint64_t)n;
+		while (now >= next_report) {
+			close_interval(st, next_report - start, &interval_bytes, total_retrans(sock));
+			next_report += p->interval_ns;
+		}
+	}
+	if (interval_bytes)
+		close_interval(st, now - start, &interval_bytes, total_retrans(sock));
+	st->elapsed_ns = now - start;
+	st->retrans = total_retrans(sock);
+	end_usage(&ru, st);
+	free(buf);
+	return rv;
+}
+
+/*
+ * Receives on sock until the sender closes the connection, with read()s
+ * of p->write_size bytes. Returns 0, or -1 if the connection failed or
+ * stayed silent for PONGRECVTOUT seconds.
+ */
+int stream_receive(int sock, const struct stream_params *p, struct stream_stats *st)
+{
+	char *buf = malloc(p->write_size);
+	uint64_t interval_bytes = 0;
+	int64_t start, now, next_report;
+	struct timeval timeout = { PONGRECVTOUT, 0 };
+	struct rusage ru;
+	ssize_t n;
+	int rv = 0;
+
+	memset(st, 0, sizeof *st);
+	if (buf == NULL)
+		fail_errno("Cannot allocate the stream buffer");
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout))
+		fail_errno("Cannot set socket timeout");
+	begin_usage(&ru);
+	start = now = now_ns();
+	next_report = start + p->interval_ns;
+	/*** no stdio inside the measurement loop ***/
+	for (;;) {
+		n = read(sock, buf, p->write_size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			rv = n < 0 ? -1 : 0;
+			break;
+		}
+		now = now_ns();
+		st->bytes += (uint64_t)n;
+		interval_bytes += (uint64_t)n;
+		while (now >= next_report) {
+			close_interval(st, next_report - start, &interval_bytes, 0);
+			next_report += p->interval_ns;
+		}
+	}
+	if (interval_bytes)
+		close_interval(st, now - start, &interval_bytes, 0);
+	st->elapsed_ns = now - start;
+	end_usage(&ru, st);
+	free(buf);
+	return rv;
+}
+
+/*
+ * The server's side of a stream goes back to the client on the control
+ * connection: a "STREAM" summary line followed by one "END_NS BYTES
+ * RETRANS" line per interval.
+ */
+int write_stream_report(int fd, const struct stream_stats *st)
+{
+	char line[128];
+	int i, len;
+	len = snprintf(line, sizeof line, "STREAM bytes=%llu ns=%lld user_ns=%lld sys_ns=%lld retrans=%u intervals=%d\n",
+		       (unsigned long long)st->bytes, (long long)st->elapsed_ns, (long long)st->cpu_user_ns,
+		       (long long)st->cpu_sys_ns, st->retrans, st->n_intervals);
+	if (blocking_write_all(fd, line, (size_t)len) != len)
+		return -1;
+	for (i = 0; i < st->n_intervals; i++) {
+		const struct stream_interval *iv = &st->intervals[i];
+		len = snprintf(line, sizeof line, "%lld %llu %u\n", (long long)iv->end_ns, (unsigned long long)iv->bytes, iv->retrans);
+		if (blocking_write_all(fd, line, (size_t)len) != len)
+			return -1;
+	}
+	return 0;
+}
+
+int read_stream_report(int fd, struct stream_stats *st)
+{
+	char line[128];
+	unsigned long long bytes;
+	long long ns, user_ns, sys_ns;
+	int i;
+
+	memset(st, 0, sizeof *st);
+	if (read_line(fd, line, sizeof line) < 0 ||
+	    sscanf(line, "STREAM bytes=%llu ns=%lld user_ns=%lld sys_ns=%lld retrans=%u intervals=%d",
+		   &bytes, &ns, &user_ns, &sys_ns, &st->retrans, &st->n_intervals) != 6 ||
+	    st->n_intervals < 0 || st->n_intervals > MAXINTERVALS)
+		return -1;
+	st->bytes = bytes;
+	st->elapsed_ns = ns;
+	st->cpu_user_ns = user_ns;
+	st->cpu_sys_ns = sys_ns;
+	for (i = 0; i < st->n_intervals; i++) {
+		struct stream_interval *iv = &st->intervals[i];
+		if (read_line(fd, line, sizeof line) < 0 || sscanf(line, "%lld %llu %u", &ns, &bytes, &iv->retrans) != 3)
+			return -1;
+		iv->end_ns = ns;
+		iv->bytes = bytes;
+	}
+	return 0;
+}
+
+static double gbits(uint64_t bytes, int64_t ns)
+{
+	return ns > 0 ? (double)bytes * 8.0 / (double)ns : 0.0;
+}
+
+static void print_side(FILE * outf, const char *role, const struct stream_stats *st)
+{
+	const double secs = st->elapsed_ns / 1e9;
+	fprintf(outf, "  %s: %llu bytes in %lg s, %lg Gbit/s, CPU %.1lf%% (user %lg s, system %lg s)\n", role,
+		(unsigned long long)st->bytes, secs, gbits(st->bytes, st->elapsed_ns),
+		secs > 0 ? 100.0 * (st->cpu_user_ns + st->cpu_sys_ns) / (double)st->elapsed_ns : 0.0,
+		st->cpu_user_ns / 1e9, st->cpu_sys_ns / 1e9);
+}
+
+/*
+ * Interval throughput as seen by both ends (they start their clocks at
+ * connect() and accept(), so interval boundaries match only roughly),
+ * then totals, retransmits and CPU utilization of each end.
+ */
+void print_stream_report(FILE * outf, const char *name, const char *sender_name, const char *receiver_name,
+			 const struct stream_stats *sender, const struct stream_stats *receiver)
+{
+	const int n = sender->n_intervals > receiver->n_intervals ? sender->n_intervals : receiver->n_intervals;
+	int64_t sender_prev = 0, receiver_prev = 0;
+	uint32_t retrans_prev = 0;
+	int i;
+
+	fprintf(outf, "\n%s interval     sent Gbit/s  received Gbit/s  retransmits\n", name);
+	for (i = 0; i < n; i++) {
+		const struct stream_interval *s = i < sender->n_intervals ? &sender->intervals[i] : NULL;
+		const struct stream_interval *r = i < receiver->n_intervals ? &receiver->intervals[i] : NULL;
+		const int64_t end = s ? s->end_ns : r->end_ns;
+		fprintf(outf, "  %6.2lf-%-6.2lf s", (s ? sender_prev : receiver_prev) / 1e9, end / 1e9);
+		if (s)
+			fprintf(outf, " %14.3lf", gbits(s->bytes, s->end_ns - sender_prev));
+		else
+			fprintf(outf, " %14s", "-");
+		if (r)
+			fprintf(outf, " %16.3lf", gbits(r->bytes, r->end_ns - receiver_prev));
+		else
+			fprintf(outf, " %16s", "-");
+		if (s)
+			fprintf(outf, " %12u\n", s->retrans - retrans_prev);
+		else
+			fprintf(outf, " %12s\n", "-");
+		if (s) {
+			sender_prev = s->end_ns;
+			retrans_prev = s->retrans;
+		}
+		if (r)
+			receiver_prev = r->end_ns;
+	}
+	if (sender->n_intervals == MAXINTERVALS || receiver->n_intervals == MAXINTERVALS)
+		fprintf(outf, "  (only the first %d intervals are reported)\n", MAXINTERVALS);
+	fprintf(outf, "\n%s Stream totals, %u retransmits\n", name, sender->retrans);
+	print_side(outf, sender_name, sender);
+	print_side(outf, receiver_name, receiver);
+}
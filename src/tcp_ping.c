@@ -19,6 +19,8 @@
  * (at your option) any later version.
  */
 
+#include <getopt.h>
+#include <sys/stat.h>
 #include "pingpong.h"
 
 /*
@@ -27,18 +29,23 @@
  * int msg_no: message sequence number (written into the message)
  * char message[msg_size]: buffer to send
  * int tcp_socket: socket file descriptor
+ * int resp_size: length of the answer expected from the server
+ * char rec_buffer[resp_size]: buffer receiving the answer
+ * int64_t *send_ns: set to the send time (CLOCK_TYPE, nanoseconds)
+ * const struct sock_options *so: --sockopt, for TCP_CORK and TCP_QUICKACK
  */
-double do_ping(size_t msg_size, int msg_no, char message[msg_size], int tcp_socket)
+double do_ping(size_t msg_size, int msg_no, char message[msg_size], int tcp_socket,
+	       size_t resp_size, char rec_buffer[resp_size], int64_t *send_ns, const struct sock_options *so)
 {
-	char rec_buffer[msg_size];
 	ssize_t recv_bytes, sent_bytes;
-	size_t offset;
+	size_t offset = 0;
 	struct timespec send_time, recv_time;
 	double RTT_ms;
+	int64_t phase_ns;
 
 	/*** write msg_no at the beginning of the message buffer ***/
 	/*** TO BE DONE START ***/
-	sprintf(message, "%d\n", msg_no);
+	sprintf(message, "%d %zu\n", msg_no, msg_size);	/* the size is read by "var=1" servers */
 	/*** TO BE DONE END ***/
 
 	/*** Store the current time in send_time ***/
@@ -46,16 +53,30 @@ double do_ping(size_t msg_size, int msg_no, char message[msg_size], int tcp_sock
 	if (clock_gettime(CLOCK_TYPE, &send_time) == -1)
 		fail_errno("Error getting time");
 	/*** TO BE DONE END ***/
+	phase_ns = trace_now();
 
 	/*** Send the message through the socket ***/
 	/*** TO BE DONE START ***/
+	if (sock_cork(tcp_socket, so, 1))
+		fail_errno("Error setting TCP_CORK");
 	sent_bytes = blocking_write_all(tcp_socket, message, msg_size);
 	if(sent_bytes < 0 || sent_bytes != msg_size)
 		fail_errno("Error sending data");
+	if (sock_cork(tcp_socket, so, 0))
+		fail_errno("Error clearing TCP_CORK");
 	/*** TO BE DONE END ***/
+	phase_ns = trace_mark(TRACE_SEND, msg_no, phase_ns);
+
+	/* traced runs read the first bytes on their own, to tell waiting from reading */
+	if (trace_on) {
+		if ((recv_bytes = recv(tcp_socket, rec_buffer, resp_size, 0)) <= 0)
+			fail_errno("Error receiving data");
+		offset = (size_t)recv_bytes;
+		phase_ns = trace_mark(TRACE_WAIT, msg_no, phase_ns);
+	}
 
 	/*** Receive answer through the socket (blocking) ***/
-	for (offset = 0; (offset + (recv_bytes = recv(tcp_socket, rec_buffer + offset, sent_bytes - offset, MSG_WAITALL))) < msg_size; offset += recv_bytes)
+	for (; offset < resp_size && (offset + (recv_bytes = recv(tcp_socket, rec_buffer + offset, resp_size - offset, MSG_WAITALL))) < resp_size; offset += recv_bytes)
 	{
 		debug(" ... received %zd bytes back\n", recv_bytes);
 		if (recv_bytes < 0)
@@ -66,11 +87,280 @@ double do_ping(size_t msg_size, int msg_no, char message[msg_size], int tcp_sock
 	if (clock_gettime(CLOCK_TYPE, &recv_time) == -1)
 		fail_errno("Error getting time");
 	/*** TO BE DONE END ***/
+	if (sock_quickack(tcp_socket, so))
+		fail_errno("Error setting TCP_QUICKACK");
 
-	printf("tcp_ping received %zd bytes back\n", recv_bytes);
+	*send_ns = timespec2ns(&send_time);
+	if (trace_on) {
+		if (offset < resp_size)
+			trace_add(TRACE_READ_REST, msg_no, phase_ns, timespec2ns(&recv_time));
+		trace_add(TRACE_PING, msg_no, *send_ns, timespec2ns(&recv_time));
+	}
 	return timespec_delta2milliseconds(&recv_time, &send_time);
 }
 
+/* do_ping() as the harness self-test runs it: no TCP options on its AF_UNIX socket */
+static double harness_do_ping(size_t msg_size, int msg_no, char message[msg_size], int sock,
+			      size_t resp_size, char answer[resp_size], int64_t *send_ns)
+{
+	static const struct sock_options no_options;
+	return do_ping(msg_size, msg_no, message, sock, resp_size, answer, send_ns, &no_options);
+}
+
+/*
+ * Opens one complete session with the Pong server, as a client with a
+ * short-lived connection would: connect, "TCP size 1" request, "OK"
+ * answer and a single ping-pong. The three phases are timed from the
+ * start of the session. With fastopen set the request travels in the SYN
+ * (MSG_FASTOPEN); *syn_data is set when the server accepted those data.
+ */
+void connect_session(struct addrinfo *server_addr, size_t msg_size, char message[msg_size], int fastopen,
+		     double *connect_ms, double *ok_ms, double *echo_ms, int *syn_data)
+{
+	char request[MAX_REQ], answer[MAX_ANSW], rec_buffer[msg_size];
+	struct timespec start_time, connect_time, ok_time, echo_time;
+	size_t request_len, offset;
+	ssize_t nr;
+	int tcp_socket;
+	struct tcp_info info;
+	socklen_t info_len = sizeof info;
+
+	sprintf(request, "TCP %zu 1\n", msg_size);
+	request_len = strlen(request);
+	sprintf(message, "%d\n", 1);
+	if (clock_gettime(CLOCK_TYPE, &start_time) == -1)
+		fail_errno("Error getting time");
+	if ((tcp_socket = socket(server_addr->ai_family, server_addr->ai_socktype, server_addr->ai_protocol)) < 0)
+		fail_errno("TCP Ping could not create socket");
+	if (fastopen) {
+		if (sendto(tcp_socket, request, request_len, MSG_FASTOPEN, server_addr->ai_addr, server_addr->ai_addrlen) != request_len)
+			fail_errno("TCP Ping could not send request with TCP Fast Open");
+	} else if (connect(tcp_socket, server_addr->ai_addr, server_addr->ai_addrlen))
+		fail_errno("Error connecting socket");
+	if (clock_gettime(CLOCK_TYPE, &connect_time) == -1)
+		fail_errno("Error getting time");
+	if (!fastopen && write(tcp_socket, request, request_len) != request_len)
+		fail_errno("Error writing request on socket");
+	nr = read(tcp_socket, answer, sizeof(answer));
+	if (nr < 2 || strncmp(answer, "OK", 2) != 0)
+		fail("TCP Ping received an unexpected answer from Pong server");
+	if (clock_gettime(CLOCK_TYPE, &ok_time) == -1)
+		fail_errno("Error getting time");
+	if (blocking_write_all(tcp_socket, message, msg_size) != msg_size)
+		fail_errno("Error sending data");
+	for (offset = 0; offset < msg_size; offset += nr)
+		if ((nr = recv(tcp_socket, rec_buffer + offset, msg_size - offset, MSG_WAITALL)) <= 0)
+			fail_errno("Error receiving data");
+	if (clock_gettime(CLOCK_TYPE, &echo_time) == -1)
+		fail_errno("Error getting time");
+	*syn_data = !getsockopt(tcp_socket, IPPROTO_TCP, TCP_INFO, &info, &info_len) && (info.tcpi_options & TCPI_OPT_SYN_DATA);
+	close(tcp_socket);
+	*connect_ms = timespec_delta2milliseconds(&connect_time, &start_time);
+	*ok_ms = timespec_delta2milliseconds(&ok_time, &start_time);
+	*echo_ms = timespec_delta2milliseconds(&echo_time, &start_time);
+}
+
+/*
+ * Connection-establishment benchmark: runs "sessions" short sessions in a
+ * row and prints the distributions of connect time, time to "OK" and time
+ * to the first echo, together with the session rate the server sustained.
+ * Returns the median time to the first echo.
+ */
+double connect_bench(struct addrinfo *server_addr, int msgsz, int sessions, int fastopen)
+{
+	double connect_ms[sessions], ok_ms[sessions], echo_ms[sessions], median;
+	char message[msgsz];
+	struct timespec start_time, end_time;
+	int i, syn_data, accepted = 0;
+	const char *const name = fastopen ? "TCP Fast Open" : "TCP";
+	char label[64];
+
+	memset(message, 0, (size_t)msgsz);
+	if (fastopen) /* first session only fetches the Fast Open cookie */
+		connect_session(server_addr, (size_t)msgsz, message, fastopen, &connect_ms[0], &ok_ms[0], &echo_ms[0], &syn_data);
+	if (clock_gettime(CLOCK_TYPE, &start_time) == -1)
+		fail_errno("Error getting time");
+	for (i = 0; i < sessions; i++) {
+		connect_session(server_addr, (size_t)msgsz, message, fastopen, &connect_ms[i], &ok_ms[i], &echo_ms[i], &syn_data);
+		accepted += syn_data;
+	}
+	if (clock_gettime(CLOCK_TYPE, &end_time) == -1)
+		fail_errno("Error getting time");
+	printf("\n%s Ping: connection setup over %d sessions of %d byte messages (%lg sessions/s)\n",
+	       name, sessions, msgsz, 1000.0 * sessions / timespec_delta2milliseconds(&end_time, &start_time));
+	if (fastopen)
+		printf(" ... SYN data accepted by the server in %d sessions out of %d\n", accepted, sessions);
+	sprintf(label, "%s connect (ms)", name);
+	print_percentiles(stdout, label, sessions, connect_ms);
+	sprintf(label, "%s time to OK (ms)", name);
+	print_percentiles(stdout, label, sessions, ok_ms);
+	sprintf(label, "%s time to first echo (ms)", name);
+	print_percentiles(stdout, label, sessions, echo_ms);
+	median = echo_ms[sessions / 2];
+	return median;
+}
+
+/*
+ * Runs norep ping-pongs of msgsz bytes on an accepted TCP test and prints
+ * the per-repetition log and the statistics once the run is over. With
+ * --tcpinfo both ends sample TCP_INFO between ping-pongs (see tcp_pong())
+ * and the windows are printed before the statistics.
+ */
+void run_pings(int tcp_socket, int msgsz, int norep, const struct ping_options *opts)
+{
+	const int respsz = response_size(msgsz, opts), every = opts->tcpinfo_every;
+	const int max_samples = every ? tcp_sample_count(every, norep) : 1;
+	double ping_times[norep];
+	int64_t send_ns[norep], server_rx_ns[norep], server_tx_ns[norep];
+	struct timespec zero, resolution;
+	char message[msgsz], answer[respsz];
+	struct perf_counters pc;
+	struct tcp_sample client_samples[max_samples], server_samples[max_samples];
+	int n_samples = 0, n_server;
+	int rep, counting = opts->perf && perf_open(&pc) == 0;
+	if (opts->perf && !counting)
+		fprintf(stderr, "TCP Ping: no performance counters: %s\n", strerror(errno));
+	memset(message, 0, (size_t)msgsz);
+	if (every && tcp_sample_take(tcp_socket, 0, &client_samples[n_samples++]))
+		fail_errno("TCP Ping cannot read TCP_INFO");
+	trace_test(0, msgsz);
+	if (counting)
+		perf_begin(&pc);
+	/*** no stdio inside the measurement loop: samples are logged afterwards ***/
+	for (rep = 1; rep <= norep; ++rep) {
+		ping_times[rep - 1] = do_ping((size_t)msgsz, rep, message, tcp_socket, (size_t)respsz, answer, &send_ns[rep - 1],
+					  &opts->sockopts);
+		if (opts->timestamps) {
+			server_rx_ns[rep - 1] = get_timestamp(answer + PONG_TS_OFFSET);
+			server_tx_ns[rep - 1] = get_timestamp(answer + PONG_TS_OFFSET + sizeof(int64_t));
+		}
+		if (every && tcp_sample_due(rep, every, norep) && tcp_sample_take(tcp_socket, rep, &client_samples[n_samples++]))
+			fail_errno("TCP Ping cannot read TCP_INFO");
+	}
+	if (counting)
+		perf_end(&pc);
+	for (rep = 1; rep <= norep; ++rep)
+		printf("Round trip time was %lg milliseconds in repetition %d\n", ping_times[rep - 1], rep);
+	if (every) {
+		if ((n_server = read_tcpinfo_report(tcp_socket, server_samples, max_samples)) < 0)
+			fail("TCP Ping received invalid TCP_INFO samples from Pong server");
+		print_tcpinfo(stdout, "TCP Ping:", ping_times, client_samples, n_samples, server_samples, n_server);
+	}
+	if (opts->sketch_path)
+		save_sketch(opts->sketch_path, "tcp", msgsz, respsz, norep, ping_times);
+	print_harness_overhead(stdout, SOCK_STREAM, (size_t)msgsz, (size_t)respsz, norep, harness_do_ping);
+	if (opts->timestamps)
+		print_breakdown(stdout, "TCP Ping:", norep, ping_times, send_ns, server_rx_ns, server_tx_ns,
+				clock_offset_ns(), opts->synced_clocks);
+	memset((void *)(&zero), 0, sizeof(struct timespec));
+	if (clock_getres(CLOCK_TYPE, &resolution))
+		fail_errno("TCP Ping could not get timer resolution");
+	print_statistics(stdout, "TCP Ping: ", norep, ping_times, msgsz, respsz, timespec_delta2milliseconds(&resolution, &zero));
+	if (counting) {
+		print_perf_counters(stdout, "TCP Ping: CPU counters", &pc, norep);
+		perf_close(&pc);
+	}
+}
+
+/*
+ * Replays a workload (--replay) on an accepted "var=1" test: message rep
+ * has w->sizes[rep - 1] bytes and is sent on the schedule of the workload,
+ * from buffers sized once for the largest message. RTTs are reported by
+ * message size.
+ */
+void run_replay(int tcp_socket, const struct workload *w, const struct ping_options *opts)
+{
+	double ping_times[w->n];
+	char message[w->max_size], answer[w->max_size];
+	int64_t send_ns, next_ns;
+	int rep;
+	memset(message, 0, (size_t)w->max_size);
+	trace_test(0, w->max_size);
+	next_ns = now_ns();
+	/*** no stdio inside the measurement loop: samples are logged afterwards ***/
+	for (rep = 1; rep <= w->n; ++rep) {
+		workload_wait(&next_ns, w->gaps_ns[rep - 1]);
+		ping_times[rep - 1] = do_ping((size_t)w->sizes[rep - 1], rep, message, tcp_socket, (size_t)w->sizes[rep - 1],
+					      answer, &send_ns, &opts->sockopts);
+	}
+	for (rep = 1; rep <= w->n; ++rep)
+		printf("Round trip time was %lg milliseconds in repetition %d (%d bytes)\n", ping_times[rep - 1], rep,
+		       w->sizes[rep - 1]);
+	print_workload_report(stdout, "TCP Ping:", w, ping_times);
+}
+
+/*
+ * Bulk transfer on its own data connection (see serve_stream()): the
+ * server answers "OK port", the client connects to that port, the sender
+ * streams until the time or byte limit and closes, then the server's
+ * measurements come back on the control connection and both ends are
+ * reported side by side.
+ */
+void run_stream(int control_socket, int write_size, const struct ping_options *opts)
+{
+	char request[MAX_REQ], answer[MAX_ANSW];
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof addr;
+	struct stream_params params;
+	struct stream_stats *client = malloc(sizeof *client), *server = malloc(sizeof *server);
+	struct stat file_stat;
+	int data_socket, port, rv;
+	const int up = opts->stream == STREAM_UP;
+
+	if (client == NULL || server == NULL)
+		fail_errno("TCP Ping cannot allocate stream statistics");
+	params.write_size = (size_t)write_size;
+	params.duration_ns = (int64_t)opts->stream_ms * 1000000;
+	params.byte_limit = (uint64_t)opts->stream_bytes;
+	params.interval_ns = (int64_t)opts->report_ms * 1000000;
+	params.file_fd = -1;
+	params.file_size = write_size;
+	if (up && opts->stream_file) {
+		if ((params.file_fd = open(opts->stream_file, O_RDONLY)) < 0 || fstat(params.file_fd, &file_stat))
+			fail_errno(opts->stream_file);
+		if ((params.file_size = file_stat.st_size) == 0)
+			fail("TCP Ping cannot stream an empty file");
+	} else if (up && opts->sendfile)
+		params.file_fd = sendfile_source(params.write_size);
+
+	printf(" ... connected to Pong server: asking for a %s stream of %d byte %s\n", up ? "client to server" : "server to client",
+	       write_size, params.file_fd >= 0 || (!up && opts->sendfile) ? "sendfile() calls" : "writes");
+	build_stream_request(request, write_size, opts);
+	if (write(control_socket, request, strlen(request)) != strlen(request))
+		fail_errno("Error writing request on socket");
+	if (read_line(control_socket, answer, sizeof answer) < 0)
+		fail_errno("TCP Ping could not receive answer from Pong server");
+	if (sscanf(answer, "OK %d", &port) != 1)
+		fail("TCP Ping received an unexpected answer from Pong server");
+	printf(" ... Pong server agreed :-)\n");
+
+	if (getpeername(control_socket, (struct sockaddr *)&addr, &addr_len))
+		fail_errno("TCP Ping cannot get the server address");
+	addr.sin_port = htons((uint16_t)port);
+	if ((data_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+		fail_errno("TCP Ping could not create socket");
+	if (opts->congestion && set_congestion(data_socket, opts->congestion))
+		fail_errno("TCP Ping cannot set the congestion control algorithm");
+	if (apply_sock_options(data_socket, 1, &opts->sockopts))
+		fail_errno("TCP Ping cannot set the socket options");
+	if (connect(data_socket, (struct sockaddr *)&addr, addr_len))
+		fail_errno("TCP Ping cannot connect the stream socket");
+	rv = up ? stream_send(data_socket, &params, client) : stream_receive(data_socket, &params, client);
+	if (rv)
+		fail_errno("TCP Ping: stream interrupted");
+	close(data_socket);
+	if (params.file_fd >= 0)
+		close(params.file_fd);
+	if (read_stream_report(control_socket, server))
+		fail("TCP Ping received an invalid stream report from Pong server");
+	if (up)
+		print_stream_report(stdout, "TCP Ping:", "client (sender)", "server (receiver)", client, server);
+	else
+		print_stream_report(stdout, "TCP Ping:", "server (sender)", "client (receiver)", server, client);
+	free(client);
+	free(server);
+}
+
 int main(int argc, char **argv)
 {
 	struct addrinfo gai_hints, *server_addrinfo;
@@ -81,9 +371,148 @@ int main(int argc, char **argv)
 	int tcp_socket;
 	char request[MAX_REQ], answer[MAX_ANSW];
 	ssize_t nr;
+	int connect_mode = 0, fastopen = 0, session_mode = 0, opt;
+	struct ping_options opts;
+	int sizes[MAXSIZES], n_sizes, i;
+	const char *replay = NULL;
+	double gap_us = 0.0;
+	static struct workload workload;
+	static const struct option long_options[] = {
+		{"connect", no_argument, NULL, 'c'},
+		{"fastopen", no_argument, NULL, 'f'},
+		{"session", no_argument, NULL, 's'},
+		{"response", required_argument, NULL, 'r'},
+		{"timestamps", no_argument, NULL, 't'},
+		{"synced", no_argument, NULL, 'S'},
+		{"sketch", required_argument, NULL, 'k'},
+		{"bulk", required_argument, NULL, 'b'},
+		{"time", required_argument, NULL, 'T'},
+		{"bytes", required_argument, NULL, 'B'},
+		{"interval", required_argument, NULL, 'i'},
+		{"sendfile", no_argument, NULL, 'F'},
+		{"file", required_argument, NULL, 'P'},
+		{"trace", required_argument, NULL, 'Q'},
+		{"perf", no_argument, NULL, 'E'},
+		{"tcpinfo", required_argument, NULL, 'I'},
+		{"cc", required_argument, NULL, 'C'},
+		{"replay", required_argument, NULL, 'W'},
+		{"gap", required_argument, NULL, 'G'},
+		{"sockopt", required_argument, NULL, 'O'},
+		{NULL, 0, NULL, 0}
+	};
 
+	memset(&opts, 0, sizeof opts);
+	opts.report_ms = STREAM_INTERVAL;
+	while ((opt = getopt_long(argc, argv, "cfsr:tk:b:T:B:i:F", long_options, NULL)) != -1)
+		switch (opt) {
+		case 'c':
+			connect_mode = 1;
+			break;
+		case 'f':
+			fastopen = 1;
+			break;
+		case 's':
+			session_mode = 1;
+			break;
+		case 'r':
+			if (sscanf(optarg, "%d", &opts.resp_size) != 1 || opts.resp_size < MINSIZE || opts.resp_size > MAXTCPSIZE)
+				fail("Incorrect response size");
+			break;
+		case 't':
+			opts.timestamps = 1;
+			break;
+		case 'S':
+			opts.synced_clocks = 1;
+			break;
+		case 'k':
+			opts.sketch_path = optarg;
+			break;
+		case 'b':
+			if (strcmp(optarg, "up") == 0)
+				opts.stream = STREAM_UP;
+			else if (strcmp(optarg, "down") == 0)
+				opts.stream = STREAM_DOWN;
+			else
+				fail("Bulk direction must be up or down");
+			break;
+		case 'T': {
+			double secs;
+			if (sscanf(optarg, "%lf", &secs) != 1 || secs <= 0.0 || secs * 1000.0 > STREAM_MAXTIME)
+				fail("Incorrect stream duration");
+			opts.stream_ms = (int)(secs * 1000.0 + 0.5);
+			break;
+		}
+		case 'B':
+			if (sscanf(optarg, "%lld", &opts.stream_bytes) != 1 || opts.stream_bytes <= 0)
+				fail("Incorrect stream byte count");
+			break;
+		case 'i':
+			if (sscanf(optarg, "%d", &opts.report_ms) != 1 || opts.report_ms < STREAM_MININTERVAL)
+				fail("Incorrect report interval");
+			break;
+		case 'F':
+			opts.sendfile = 1;
+			break;
+		case 'P':
+			opts.stream_file = optarg;
+			opts.sendfile = 1;
+			break;
+		case 'Q':
+			trace_start(optarg, "tcp_ping");
+			break;
+		case 'E':
+			opts.perf = 1;
+			break;
+		case 'I':
+			if (sscanf(optarg, "%d", &opts.tcpinfo_every) != 1 || opts.tcpinfo_every < 1)
+				fail("Incorrect TCP_INFO sampling interval");
+			break;
+		case 'C':
+			if (strlen(optarg) >= CC_NAME_MAX || strchr(optarg, ' '))
+				fail("Incorrect congestion control algorithm");
+			opts.congestion = optarg;
+			break;
+		case 'W':
+			replay = optarg;
+			break;
+		case 'G':
+			if (sscanf(optarg, "%lf", &gap_us) != 1 || gap_us < 0.0)
+				fail("Incorrect gap between messages");
+			break;
+		case 'O':
+			if (parse_sock_options(optarg, &opts.sockopts))
+				fail("Incorrect socket options");
+			opts.sockopt_spec = optarg;
+			break;
+		default:
+			fail("Incorrect parameters provided. Use: tcp_ping [-c [-f]] [-s] [-r RESP_SIZE] [-t [--synced]] [-k SKETCH_FILE] [--trace FILE] [--perf] [--tcpinfo N] [--cc ALGO] [--replay WORKLOAD [--gap US]] [--sockopt LIST] [-b up|down [-T SEC] [-B BYTES] [-i MS] [-F] [--file PATH]] PONG_ADDR PONG_PORT SIZE[,SIZE...] [NO_REP]\n");
+		}
+	/*** from here on argv[1..] are the positional parameters ***/
+	argc -= optind - 1;
+	argv += optind - 1;
 	if (argc < 4)
-		fail("Incorrect parameters provided. Use: tcp_ping PONG_ADDR PONG_PORT SIZE [NO_REP]\n");
+		fail("Incorrect parameters provided. Use: tcp_ping [-c [-f]] [-s] [-r RESP_SIZE] [-t [--synced]] [-k SKETCH_FILE] [--trace FILE] [--perf] [--tcpinfo N] [--cc ALGO] [--replay WORKLOAD [--gap US]] [--sockopt LIST] [-b up|down [-T SEC] [-B BYTES] [-i MS] [-F] [--file PATH]] PONG_ADDR PONG_PORT SIZE[,SIZE...] [NO_REP]\n");
+	if ((n_sizes = parse_size_list(argv[3], sizes, MAXSIZES)) < 0)
+		fail("Incorrect format of size parameter");
+	for (i = 0; i < n_sizes; i++)
+		if (sizes[i] < MINSIZE)
+			sizes[i] = MINSIZE;
+		else if (sizes[i] > MAXTCPSIZE)
+			sizes[i] = MAXTCPSIZE;
+	for (i = 0; i < n_sizes; i++)
+		if (opts.timestamps && response_size(sizes[i], &opts) < PONG_TS_MINSIZE)
+			fail("Server timestamps need responses of at least 32 bytes");
+	if (opts.stream && (opts.resp_size || opts.timestamps || connect_mode || n_sizes > 1))
+		fail("A bulk transfer has a single size and no response size, timestamps or connect mode");
+	if ((opts.tcpinfo_every && opts.stream) || ((opts.tcpinfo_every || opts.congestion || opts.sockopt_spec) && connect_mode))
+		fail("TCP_INFO sampling needs a ping-pong run, congestion control and socket options are not chosen in connect mode");
+	if (opts.stream && !opts.stream_ms && !opts.stream_bytes)
+		opts.stream_ms = STREAM_TIME;
+	/*** a sweep over several sizes shares one control session ***/
+	if (n_sizes > 1)
+		session_mode = 1;
+	if (session_mode && !opts.stream && (opts.sockopts.set & SOCKOPT_BUFFERS))
+		fail("The tests of a session share the control connection: sndbuf and rcvbuf cannot be chosen for them");
 	for (nr = 4, norep = REPEATS; nr < argc; nr++)
 		if (*argv[nr] >= '1' && *argv[nr] <= '9')
 			sscanf(argv[nr], "%d", &norep);
@@ -91,6 +520,16 @@ int main(int argc, char **argv)
 		norep = MINREPEATS;
 	else if (norep > MAXREPEATS)
 		norep = MAXREPEATS;
+	/*** a replay is a single "var=1" test: SIZE bounds its messages ***/
+	if (replay) {
+		if (n_sizes > 1 || opts.resp_size || opts.timestamps || opts.stream || connect_mode || opts.sketch_path ||
+		    opts.tcpinfo_every || opts.perf)
+			fail("A replay has a single maximum size and no response size, timestamps, sketch, TCP_INFO, counters, bulk or connect mode");
+		load_workload(replay, norep, gap_us, sizes[0], &workload);
+		sizes[0] = workload.max_size;
+		norep = workload.n;
+		opts.variable = 1;
+	}
 
 	/*** Initialize hints in order to specify socket options ***/
 	memset(&gai_hints, 0, sizeof gai_hints);
@@ -111,6 +550,19 @@ int main(int argc, char **argv)
 	ipv4 = (struct sockaddr_in *)server_addrinfo->ai_addr;
 	printf("TCP Ping trying to connect to server %s (%s) on port %s\n", argv[1], inet_ntop(AF_INET, &ipv4->sin_addr, ipstr, INET_ADDRSTRLEN), argv[2]);
 
+	if (connect_mode) {
+		double plain_ms, fastopen_ms;
+		msgsz = sizes[0];
+		plain_ms = connect_bench(server_addrinfo, msgsz, norep, 0);
+		if (fastopen) {
+			fastopen_ms = connect_bench(server_addrinfo, msgsz, norep, 1);
+			printf("\nTCP Fast Open changed the median time to first echo by %lg ms (%lg vs %lg)\n",
+			       fastopen_ms - plain_ms, fastopen_ms, plain_ms);
+		}
+		freeaddrinfo(server_addrinfo);
+		exit(EXIT_SUCCESS);
+	}
+
 	/*** create a new TCP socket and connect it with the server ***/
 	/*** TO BE DONE START ***/
 	struct addrinfo *addr;
@@ -119,6 +571,9 @@ int main(int argc, char **argv)
 	{
 		if ((tcp_socket = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0)
 			continue;
+		/*** buffer sizes before connect(): they also choose the window scale ***/
+		if (apply_sock_options(tcp_socket, 1, &opts.sockopts))
+			fail_errno("TCP Ping cannot set the socket options");
 		if (connect(tcp_socket, addr->ai_addr, addr->ai_addrlen) == 0)
 			break;
 		close(tcp_socket);
@@ -129,52 +584,51 @@ int main(int argc, char **argv)
 	/*** TO BE DONE END ***/
 
 	freeaddrinfo(server_addrinfo);
-	if (sscanf(argv[3], "%d", &msgsz) != 1)
-		fail("Incorrect format of size parameter");
-	if (msgsz < MINSIZE)
-		msgsz = MINSIZE;
-	else if (msgsz > MAXTCPSIZE)
-		msgsz = MAXTCPSIZE;
-	printf(" ... connected to Pong server: asking for %d repetitions of %d bytes TCP messages\n", norep, msgsz);
-	sprintf(request, "TCP %d %d\n", msgsz, norep);
-
-	/*** Write the request on socket ***/
-	/*** TO BE DONE START ***/
-	size_t request_len = strlen(request);
-	if (write(tcp_socket, request, request_len) != request_len)
-		fail_errno("Error writing request on socket");
-	/*** TO BE DONE END ***/
+	if (opts.congestion && set_congestion(tcp_socket, opts.congestion))
+		fail_errno("TCP Ping cannot set the congestion control algorithm");
+	if (session_mode && start_session(tcp_socket))
+		fail("TCP Ping: Pong server refused the control session");
+	if (opts.stream) {
+		run_stream(tcp_socket, sizes[0], &opts);
+		if (session_mode)
+			end_session(tcp_socket);
+		close(tcp_socket);
+		exit(EXIT_SUCCESS);
+	}
+	for (i = 0; i < n_sizes; i++) {
+		msgsz = sizes[i];
+		if (opts.variable)
+			printf(" ... connected to Pong server: replaying %d TCP messages of up to %d bytes\n", norep, msgsz);
+		else
+			printf(" ... connected to Pong server: asking for %d repetitions of %d bytes TCP messages\n", norep, msgsz);
+		build_request(request, "TCP", msgsz, norep, &opts);
 
-	nr = read(tcp_socket, answer, sizeof(answer));
-	if (nr < 0)
-		fail_errno("TCP Ping could not receive answer from Pong server");
+		/*** Write the request on socket ***/
+		/*** TO BE DONE START ***/
+		size_t request_len = strlen(request);
+		if (write(tcp_socket, request, request_len) != request_len)
+			fail_errno("Error writing request on socket");
+		/*** TO BE DONE END ***/
 
-	/*** Check if the answer is OK, and fail if it is not ***/
-	/*** TO BE DONE START ***/
-	if (strncmp(answer, "OK", 2) != 0)
-		fail("TCP Ping received an unexpected answer from Pong server");
-	/*** TO BE DONE END ***/
+		nr = read_line(tcp_socket, answer, sizeof(answer));
+		if (nr < 0)
+			fail_errno("TCP Ping could not receive answer from Pong server");
 
-	/*** else ***/
-	printf(" ... Pong server agreed :-)\n");
+		/*** Check if the answer is OK, and fail if it is not ***/
+		/*** TO BE DONE START ***/
+		if (strncmp(answer, "OK", 2) != 0)
+			fail("TCP Ping received an unexpected answer from Pong server");
+		/*** TO BE DONE END ***/
 
-	{
-		double ping_times[norep];
-		struct timespec zero, resolution;
-		char message[msgsz];
-		int rep;
-		memset(message, 0, (size_t)msgsz);
-		for (rep = 1; rep <= norep; ++rep)
-		{
-			double current_time = do_ping((size_t)msgsz, rep, message, tcp_socket);
-			ping_times[rep - 1] = current_time;
-			printf("Round trip time was %lg milliseconds in repetition %d\n", current_time, rep);
-		}
-		memset((void *)(&zero), 0, sizeof(struct timespec));
-		if (clock_getres(CLOCK_TYPE, &resolution))
-			fail_errno("TCP Ping could not get timer resolution");
-		print_statistics(stdout, "TCP Ping: ", norep, ping_times, msgsz, timespec_delta2milliseconds(&resolution, &zero));
+		/*** else ***/
+		printf(" ... Pong server agreed :-)\n");
+		if (opts.variable)
+			run_replay(tcp_socket, &workload, &opts);
+		else
+			run_pings(tcp_socket, msgsz, norep, &opts);
 	}
+	if (session_mode)
+		end_session(tcp_socket);
 
 	shutdown(tcp_socket, SHUT_RDWR);
 	close(tcp_socket);
@@ -0,0 +1,184 @@
+/*
+ * tcpinfo.c: campionamento di getsockopt(TCP_INFO) durante un ping-pong
+ *            TCP (srtt, rttvar, cwnd, ritrasmissioni, delivery rate e
+ *            pacing rate), rapporto dei campioni del server al client e
+ *            stampa affiancata agli RTT applicativi di ogni finestra;
+ *            scelta dell'algoritmo di controllo della congestione
+ *            (TCP_CONGESTION).
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stddef.h>
+#include "pingpong.h"
+
+/*
+ * glibc's struct tcp_info stops at tcpi_total_retrans; the kernel's goes
+ * on with these fields (include/uapi/linux/tcp.h). The returned length
+ * tells which of them the running kernel filled in.
+ */
+struct tcp_info_ext {
+	struct tcp_info base;
+	uint64_t tcpi_pacing_rate;
+	uint64_t tcpi_max_pacing_rate;
+	uint64_t tcpi_bytes_acked;
+	uint64_t tcpi_bytes_received;
+	uint32_t tcpi_segs_out;
+	uint32_t tcpi_segs_in;
+	uint32_t tcpi_notsent_bytes;
+	uint32_t tcpi_min_rtt;
+	uint32_t tcpi_data_segs_in;
+	uint32_t tcpi_data_segs_out;
+	uint64_t tcpi_delivery_rate;
+};
+
+#define HAS_FIELD(len, field) ((len) >= offsetof(struct tcp_info_ext, field) + sizeof(((struct tcp_info_ext *)0)->field))
+
+/* Rates the kernel does not report are left at 0 */
+int tcp_sample_take(int sock, int rep, struct tcp_sample *s)
+{
+	struct tcp_info_ext info;
+	socklen_t len = sizeof info;
+	memset(&info, 0, sizeof info);
+	if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len))
+		return -1;
+	s->rep = rep;
+	s->srtt_us = info.base.tcpi_rtt;
+	s->rttvar_us = info.base.tcpi_rttvar;
+	s->cwnd = info.base.tcpi_snd_cwnd;
+	s->retrans = info.base.tcpi_total_retrans;
+	s->pacing_rate = HAS_FIELD(len, tcpi_pacing_rate) ? info.tcpi_pacing_rate : 0;
+	s->delivery_rate = HAS_FIELD(len, tcpi_delivery_rate) ? info.tcpi_delivery_rate : 0;
+	return 0;
+}
+
+/* Samples are taken after repetition 0 (the baseline), every `every` and the last */
+int tcp_sample_due(int rep, int every, int norep)
+{
+	return rep % every == 0 || rep == norep;
+}
+
+int tcp_sample_count(int every, int norep)
+{
+	return 1 + norep / every + (norep % every != 0);
+}
+
+int set_congestion(int sock, const char *algo)
+{
+	return setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, algo, (socklen_t)strlen(algo));
+}
+
+/* Current algorithm of sock, so that it can be set back after a test */
+int get_congestion(int sock, char algo[CC_NAME_MAX])
+{
+	socklen_t len = CC_NAME_MAX - 1;
+	memset(algo, 0, CC_NAME_MAX);
+	return getsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, algo, &len);
+}
+
+/*
+ * "TCPINFO samples=K" and K lines "rep srtt rttvar cwnd retrans delivery
+ * pacing", sent by the server on the test connection after the last reply.
+ */
+int write_tcpinfo_report(int fd, const struct tcp_sample *samples, int n)
+{
+	char line[128];
+	int i, len;
+	len = snprintf(line, sizeof line, "TCPINFO samples=%d\n", n);
+	if (blocking_write_all(fd, line, (size_t)len) != len)
+		return -1;
+	for (i = 0; i < n; i++) {
+		const struct tcp_sample *s = &samples[i];
+		len = snprintf(line, sizeof line, "%d %u %u %u %u %llu %llu\n", s->rep, s->srtt_us, s->rttvar_us, s->cwnd,
+			       s->retrans, (unsigned long long)s->delivery_rate, (unsigned long long)s->pacing_rate);
+		if (blocking_write_all(fd, line, (size_t)len) != len)
+			return -1;
+	}
+	return 0;
+}
+
+/* Returns the number of samples read (at most max_samples), -1 on errors */
+int read_tcpinfo_report(int fd, struct tcp_sample *samples, int max_samples)
+{
+	char line[128];
+	unsigned long long delivery, pacing;
+	int i, n;
+
+	if (read_line(fd, line, sizeof line) < 0 || sscanf(line, "TCPINFO samples=%d", &n) != 1 ||
+	    n < 0 || n > max_samples)
+		return -1;
+	for (i = 0; i < n; i++) {
+		struct tcp_sample *s = &samples[i];
+		if (read_line(fd, line, sizeof line) < 0 ||
+		    sscanf(line, "%d %u %u %u %u %llu %llu", &s->rep, &s->srtt_us, &s->rttvar_us, &s->cwnd, &s->retrans,
+			   &delivery, &pacing) != 7)
+			return -1;
+		s->delivery_rate = delivery;
+		s->pacing_rate = pacing;
+	}
+	return n;
+}
+
+static void print_sample_header(FILE * outf)
+{
+	fprintf(outf, " %8s %8s %5s %4s %9s %9s", "srtt", "rttvar", "cwnd", "retr", "delivery", "pacing");
+}
+
+static void print_sample(FILE * outf, const struct tcp_sample *s, const struct tcp_sample *prev)
+{
+	fprintf(outf, " %8.3lf %8.3lf %5u %4u %9.2lf %9.2lf", s->srtt_us / 1e3, s->rttvar_us / 1e3, s->cwnd,
+		s->retrans - prev->retrans, s->delivery_rate * 8 / 1e6, s->pacing_rate * 8 / 1e6);
+}
+
+/*
+ * One line per sample window: the repetitions it covers, the median and
+ * maximum application RTT measured in them and what the kernel reported
+ * at its end on each side (srtt and rttvar in ms, retransmissions within
+ * the window, rates in Mbit/s). The server columns are left out when its
+ * samples do not match the client's (n_server < 0: no report).
+ */
+void print_tcpinfo(FILE * outf, const char *name, const double rtt[], const struct tcp_sample *client, int n_client,
+		   const struct tcp_sample *server, int n_server)
+{
+	const int both = n_server == n_client;
+	double window[client[n_client - 1].rep];
+	int i, j, n;
+
+	fprintf(outf, "\n%s TCP_INFO over %d windows (srtt, rttvar in ms, rates in Mbit/s)\n", name, n_client - 1);
+	fprintf(outf, "%33s | %-49s%s\n", "application RTT", "client", both ? " | server" : "");
+	fprintf(outf, "%13s %9s %9s |", "repetitions", "median", "max");
+	print_sample_header(outf);
+	if (both) {
+		fprintf(outf, " |");
+		print_sample_header(outf);
+	}
+	fprintf(outf, "\n");
+	for (i = 1; i < n_client; i++) {
+		for (n = 0, j = client[i - 1].rep; j < client[i].rep; j++)
+			window[n++] = rtt[j];
+		qsort(window, (size_t)n, sizeof(double), double_cmp);
+		fprintf(outf, "%6d-%-6d %9.4lf %9.4lf |", client[i - 1].rep + 1, client[i].rep, window[n / 2], window[n - 1]);
+		print_sample(outf, &client[i], &client[i - 1]);
+		if (both && server[i].rep == client[i].rep) {
+			fprintf(outf, " |");
+			print_sample(outf, &server[i], &server[i - 1]);
+		}
+		fprintf(outf, "\n");
+	}
+	if (n_server >= 0 && !both)
+		fprintf(outf, "%s the server sent %d TCP_INFO samples instead of %d\n", name, n_server, n_client);
+}
@@ -0,0 +1,66 @@
+/*
+ * timestamps.c: funzioni ausiliarie per i timestamp scritti nei messaggi
+ *               del ping-pong
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include "pingpong.h"
+
+/* Timestamps travel inside messages as 64-bit big-endian nanosecond
+   counts, so that hosts of any endianness can exchange them. */
+
+int64_t timespec2ns(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+void put_timestamp(char *buf, int64_t ns)
+{
+	uint64_t be = htobe64((uint64_t)ns);
+	memcpy(buf, &be, sizeof be);
+}
+
+int64_t get_timestamp(const char *buf)
+{
+	uint64_t be;
+	memcpy(&be, buf, sizeof be);
+	return (int64_t)be64toh(be);
+}
+
+/* current CLOCK_TYPE time in nanoseconds */
+int64_t now_ns(void)
+{
+	struct timespec now;
+	if (clock_gettime(CLOCK_TYPE, &now) == -1)
+		fail_errno("Error getting time");
+	return timespec2ns(&now);
+}
+
+/*
+ * Returns the value to add to a CLOCK_TYPE reading, in nanoseconds, to
+ * express it on the TS_CLOCK_TYPE time line. The TS_CLOCK_TYPE reading is
+ * taken between two CLOCK_TYPE readings and matched with their midpoint.
+ */
+int64_t clock_offset_ns(void)
+{
+	struct timespec before, wall, after;
+	if (clock_gettime(CLOCK_TYPE, &before) || clock_gettime(TS_CLOCK_TYPE, &wall) || clock_gettime(CLOCK_TYPE, &after))
+		fail_errno("Error getting time");
+	return timespec2ns(&wall) - (timespec2ns(&before) + timespec2ns(&after)) / 2;
+}
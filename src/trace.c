@@ -0,0 +1,130 @@
+/*
+ * trace.c: tracciamento delle fasi di ogni ping-pong (invio, attesa del
+ *          primo byte, lettura del resto, ritrasmissioni, risposta del
+ *          server) in un buffer circolare allocato in anticipo, scritto
+ *          all'uscita del programma nel formato JSON dei trace di
+ *          Chrome/Perfetto.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "pingpong.h"
+
+struct trace_record {
+	int64_t start_ns, end_ns;
+	int32_t rep, size;
+	uint8_t phase, is_udp;
+};
+
+static const char *const phase_names[TRACE_PHASES] = {
+	[TRACE_PING] = "ping",
+	[TRACE_SEND] = "send",
+	[TRACE_WAIT] = "wait",
+	[TRACE_READ_REST] = "read rest",
+	[TRACE_TIMEOUT] = "timeout",
+	[TRACE_READ] = "read",
+	[TRACE_REPLY] = "reply",
+};
+
+int trace_on;
+
+static struct trace_record *ring;
+static uint64_t n_records;	/* ever recorded: the ring keeps the last TRACE_RECORDS */
+static int test_is_udp, test_size;
+static char *trace_path;
+static const char *trace_name;
+
+static void trace_flush(void);
+
+/*
+ * Starts tracing: the ring is allocated and touched here, so recording
+ * never allocates or faults, and it is written to path, as Chrome trace
+ * JSON, when the program exits (also through fail()). name labels the
+ * process on the timeline.
+ */
+void trace_start(const char *path, const char *name)
+{
+	if (ring == NULL) {
+		if ((ring = calloc(TRACE_RECORDS, sizeof *ring)) == NULL)
+			fail_errno("Cannot allocate the trace buffer");
+		memset(ring, 0, TRACE_RECORDS * sizeof *ring);
+		if (atexit(trace_flush))
+			fail("Cannot register the trace writer");
+	}
+	free(trace_path);
+	if ((trace_path = strdup(path)) == NULL)
+		fail_errno("Cannot allocate the trace buffer");
+	trace_name = name;
+	n_records = 0;
+	trace_on = 1;
+}
+
+/* Protocol and message size of the records that follow */
+void trace_test(int is_udp, int size)
+{
+	test_is_udp = is_udp;
+	test_size = size;
+}
+
+/* Records a phase of repetition rep; returns end_ns, the start of the next phase */
+int64_t trace_add(int phase, int rep, int64_t start_ns, int64_t end_ns)
+{
+	struct trace_record *r = &ring[n_records++ % TRACE_RECORDS];
+	r->start_ns = start_ns;
+	r->end_ns = end_ns;
+	r->rep = rep;
+	r->size = test_size;
+	r->phase = (uint8_t)phase;
+	r->is_udp = (uint8_t)test_is_udp;
+	return end_ns;
+}
+
+/*
+ * Complete ("X") events in microseconds of CLOCK_TYPE, so that the traces
+ * of a client and a server on the same host share the time line; TCP and
+ * UDP tests are on two different tracks of the process.
+ */
+static void trace_flush(void)
+{
+	const uint64_t first = n_records > TRACE_RECORDS ? n_records - TRACE_RECORDS : 0;
+	const int pid = (int)getpid();
+	uint64_t i;
+	FILE *f;
+
+	if (!trace_on || (f = fopen(trace_path, "w")) == NULL) {
+		if (trace_on)
+			fprintf(stderr, "Cannot write the trace to %s: %s\n", trace_path, strerror(errno));
+		return;
+	}
+	trace_on = 0;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"%s\"}},\n", pid, trace_name);
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"TCP\"}},\n", pid);
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":2,\"args\":{\"name\":\"UDP\"}}", pid);
+	for (i = first; i < n_records; i++) {
+		const struct trace_record *r = &ring[i % TRACE_RECORDS];
+		fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+			"\"args\":{\"rep\":%d,\"size\":%d}}", phase_names[r->phase], r->is_udp ? "udp" : "tcp", pid,
+			r->is_udp ? 2 : 1, r->start_ns / 1e3, (r->end_ns - r->start_ns) / 1e3, r->rep, r->size);
+	}
+	fprintf(f, "\n]}\n");
+	if (fclose(f))
+		fprintf(stderr, "Cannot write the trace to %s: %s\n", trace_path, strerror(errno));
+	else if (first)
+		fprintf(stderr, "Trace %s: only the last %d of %llu phases were kept\n", trace_path, TRACE_RECORDS,
+			(unsigned long long)n_records);
+}
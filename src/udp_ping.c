@@ -19,27 +19,34 @@
  * (at your option) any later version.
  */
 
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <poll.h>
 #include "pingpong.h"
 
 /*
 * This function sends and wait for a reply on a socket.
 * char message[]: message to send
 * int messagesize: message length
+* int *lost_count: set to the number of datagrams lost before the answer
+* int resp_size: length of the answer expected from the server
+* char answer_buffer[resp_size]: buffer receiving the answer
+* int64_t *send_ns: set to the send time of the answered datagram (CLOCK_TYPE, nanoseconds)
 */
 
-double do_ping(size_t msg_size, int msg_no, char message[msg_size], int ping_socket, double timeout)
+double do_ping(size_t msg_size, int msg_no, char message[msg_size], int ping_socket, double timeout, int *lost_count,
+	       size_t resp_size, char answer_buffer[resp_size], int64_t *send_ns)
 {
-	int lost_count = 0;
-	char answer_buffer[msg_size];
 	ssize_t recv_bytes, sent_bytes;
 	struct timespec send_time, recv_time;
 	double roundtrip_time_ms;
 	int re_try = 0;
         int recv_errno;
+	int64_t phase_ns, first_ns = trace_now();
 
     /*** write msg_no at the beginning of the message buffer ***/
 /*** TO BE DONE START ***/
-sprintf(message, "%d\n", msg_no);
+sprintf(message, "%d %zu\n", msg_no, msg_size);	/* the size is read by "var=1" servers */
 /*** TO BE DONE END ***/
 
 	do {
@@ -49,6 +56,7 @@ sprintf(message, "%d\n", msg_no);
 	if (clock_gettime(CLOCK_TYPE, &send_time) == 1)
 		fail_errno("Error getting time");
 /*** TO BE DONE END ***/
+		phase_ns = trace_now();
 
 	/*** Send the message through the socket ***/
 /*** TO BE DONE START ***/
@@ -57,10 +65,11 @@ sprintf(message, "%d\n", msg_no);
 			fail_errno("Error sending data");
 
 /*** TO BE DONE END ***/
+		phase_ns = trace_mark(TRACE_SEND, msg_no, phase_ns);
 
 	/*** Receive answer through the socket (non blocking mode) ***/
 /*** TO BE DONE START ***/
-		recv_bytes = recv(ping_socket, answer_buffer, sent_bytes, 0);
+		recv_bytes = recv(ping_socket, answer_buffer, resp_size, 0);
 		recv_errno = errno; //salvo sempre errno
 /*** TO BE DONE END ***/
 
@@ -75,29 +84,39 @@ sprintf(message, "%d\n", msg_no);
 		while ( recv_bytes < 0 && (recv_errno == EAGAIN ||
                                            recv_errno == EWOULDBLOCK) &&
                         roundtrip_time_ms < timeout) {
-			recv_bytes = recv(ping_socket, answer_buffer, sizeof(answer_buffer), 0);
+			recv_bytes = recv(ping_socket, answer_buffer, resp_size, 0);
                         recv_errno = errno;
 			clock_gettime(CLOCK_TYPE, &recv_time);
 			roundtrip_time_ms = timespec_delta2milliseconds(&recv_time, &send_time);
 		}
 		if (recv_bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
 			fail_errno("UDP ping could not recv from UDP socket");
-		if (recv_bytes < sent_bytes) {	/*time-out elapsed: packet was lost */
-			lost_count++;
+		trace_mark(recv_bytes == (ssize_t)resp_size ? TRACE_WAIT : TRACE_TIMEOUT, msg_no, phase_ns);
+		if (recv_bytes < (ssize_t)resp_size) {	/*time-out elapsed: packet was lost */
 			if (recv_bytes < 0)
 				recv_bytes = 0;
-			printf("\n ... received %zd bytes instead of %zd (lost count = %d); re-trying ...\n", recv_bytes, sent_bytes, lost_count);
 			if (++re_try > MAXUDPRESEND) {
-				printf(" ... giving-up!\n");
+				printf("\n ... received %zd bytes instead of %zu (lost count = %d); giving-up!\n", recv_bytes, resp_size, re_try);
 				fail("too many lost datagrams");
 			}
-			printf(" ... re-trying ...\n");
 		}
-	} while (sent_bytes != recv_bytes);
+	} while (recv_bytes != (ssize_t)resp_size);
 
+	*lost_count = re_try;
+	*send_ns = timespec2ns(&send_time);
+	if (trace_on)
+		trace_add(TRACE_PING, msg_no, first_ns, timespec2ns(&recv_time));
 	return roundtrip_time_ms;
 }
 
+/* do_ping() as the harness self-test runs it, on an AF_UNIX datagram socket */
+static double harness_do_ping(size_t msg_size, int msg_no, char message[msg_size], int sock,
+			      size_t resp_size, char answer[resp_size], int64_t *send_ns)
+{
+	int lost_count;
+	return do_ping(msg_size, msg_no, message, sock, UDP_TIMEOUT, &lost_count, resp_size, answer, send_ns);
+}
+
 int prepare_udp_socket(char *pong_addr, char *pong_port)
 {
 	struct addrinfo gai_hints, *pong_addrinfo = NULL;
@@ -151,6 +170,189 @@ int prepare_udp_socket(char *pong_addr, char *pong_port)
 	return ping_socket;
 }
 
+/*
+ * Runs norep ping-pongs of msg_size bytes on the UDP socket and prints the
+ * per-repetition log and the statistics once the run is over.
+ */
+void run_pings(int ping_socket, int msg_size, int norep, const struct ping_options *opts)
+{
+	const int resp_size = response_size(msg_size, opts);
+	char message[msg_size], answer[resp_size];
+	double ping_times[norep];
+	int64_t send_ns[norep], server_rx_ns[norep], server_tx_ns[norep];
+	int lost[norep];
+	struct timespec zero, resolution;
+	struct perf_counters pc;
+	int repeat, counting = opts->perf && perf_open(&pc) == 0;
+	if (opts->perf && !counting)
+		fprintf(stderr, "UDP Ping: no performance counters: %s\n", strerror(errno));
+	memset(&message, 0, (size_t)msg_size);
+	trace_test(1, msg_size);
+	if (counting)
+		perf_begin(&pc);
+	/*** no stdio inside the measurement loop: samples are logged afterwards ***/
+	for (repeat = 0; repeat < norep; repeat++) {
+		ping_times[repeat] = do_ping((size_t)msg_size, repeat + 1, message, ping_socket, UDP_TIMEOUT, &lost[repeat],
+					     (size_t)resp_size, answer, &send_ns[repeat]);
+		if (opts->timestamps) {
+			server_rx_ns[repeat] = get_timestamp(answer + PONG_TS_OFFSET);
+			server_tx_ns[repeat] = get_timestamp(answer + PONG_TS_OFFSET + sizeof(int64_t));
+		}
+	}
+	if (counting)
+		perf_end(&pc);
+	for (repeat = 0; repeat < norep; repeat++) {
+		if (lost[repeat])
+			printf(" ... %d datagram(s) lost and re-sent in repetition %d\n", lost[repeat], repeat + 1);
+		printf("Round trip time was %lg milliseconds in repetition %d\n", ping_times[repeat], repeat + 1);
+	}
+	if (opts->sketch_path)
+		save_sketch(opts->sketch_path, "udp", msg_size, resp_size, norep, ping_times);
+	print_harness_overhead(stdout, SOCK_DGRAM, (size_t)msg_size, (size_t)resp_size, norep, harness_do_ping);
+	if (opts->timestamps)
+		print_breakdown(stdout, "UDP Ping:", norep, ping_times, send_ns, server_rx_ns, server_tx_ns,
+				clock_offset_ns(), opts->synced_clocks);
+	memset((void *)(&zero), 0, sizeof(struct timespec));
+	if (clock_getres(CLOCK_TYPE, &resolution) != 0)
+		fail_errno("UDP Ping could not get timer resolution");
+	print_statistics(stdout, "UDP Ping: ", norep, ping_times, msg_size, resp_size, timespec_delta2milliseconds(&resolution, &zero));
+	if (counting) {
+		print_perf_counters(stdout, "UDP Ping: CPU counters", &pc, norep);
+		perf_close(&pc);
+	}
+}
+
+/*
+ * Replays a workload (--replay) on an accepted "var=1" test: datagram rep
+ * has w->sizes[rep - 1] bytes and is sent on the schedule of the workload,
+ * from buffers sized once for the largest datagram. RTTs are reported by
+ * datagram size.
+ */
+void run_replay(int ping_socket, const struct workload *w)
+{
+	char message[w->max_size], answer[w->max_size];
+	double ping_times[w->n];
+	int64_t send_ns, next_ns;
+	int lost[w->n];
+	int repeat;
+	memset(message, 0, (size_t)w->max_size);
+	trace_test(1, w->max_size);
+	next_ns = now_ns();
+	/*** no stdio inside the measurement loop: samples are logged afterwards ***/
+	for (repeat = 0; repeat < w->n; repeat++) {
+		workload_wait(&next_ns, w->gaps_ns[repeat]);
+		ping_times[repeat] = do_ping((size_t)w->sizes[repeat], repeat + 1, message, ping_socket, UDP_TIMEOUT, &lost[repeat],
+					     (size_t)w->sizes[repeat], answer, &send_ns);
+	}
+	for (repeat = 0; repeat < w->n; repeat++) {
+		if (lost[repeat])
+			printf(" ... %d datagram(s) lost and re-sent in repetition %d\n", lost[repeat], repeat + 1);
+		printf("Round trip time was %lg milliseconds in repetition %d (%d bytes)\n", ping_times[repeat], repeat + 1,
+		       w->sizes[repeat]);
+	}
+	print_workload_report(stdout, "UDP Ping:", w, ping_times);
+}
+
+/*
+ * Loss measurement ("loss=1"): count datagrams are sent one every
+ * opts->interval_ms without waiting for the answers, and nothing makes the
+ * run abort. Each datagram carries its send time, echoed back by the
+ * server, so RTTs need no per-datagram state: client and server both run
+ * in constant memory however long the test. At the end the client writes
+ * "END" on the control connection and gets the server's view of the
+ * uplink.
+ */
+void run_loss_test(int ping_socket, int control_socket, int msg_size, int count, const struct ping_options *opts)
+{
+	const int resp_size = response_size(msg_size, opts);
+	const int64_t interval_ns = (int64_t)(opts->interval_ms * 1e6);
+	char message[msg_size], answer[resp_size], stats_line[256];
+	struct latency_hist *rtt_hist;
+	struct seq_stats round_trip, uplink;
+	unsigned long long send_errors = 0, recv_errors = 0, invalid = 0, server_sent = 0, server_invalid = 0;
+	int64_t now, next_send, deadline = 0;
+	struct pollfd pfd;
+	struct timespec wait;
+	ssize_t recv_bytes;
+	uint64_t received_before;
+	int seq = 1, rseq, consumed;
+
+	if (!(rtt_hist = malloc(sizeof *rtt_hist)))
+		fail("UDP Ping cannot allocate the RTT histogram");
+	hist_init(rtt_hist);
+	seq_stats_init(&round_trip);
+	memset(message, 0, (size_t)msg_size);
+	pfd.fd = ping_socket;
+	pfd.events = POLLIN;
+	/*** no stdio inside the measurement loop ***/
+	for (next_send = now = now_ns();;) {
+		if (seq <= count && now >= next_send) {
+			sprintf(message, "%d\n", seq);
+			put_timestamp(message + PONG_CLIENT_TS_OFFSET, now);
+			if (send(ping_socket, message, (size_t)msg_size, 0) != msg_size)
+				++send_errors;
+			next_send += interval_ns;
+			if (next_send < now) /* we fell behind: do not burst to catch up */
+				next_send = now;
+			if (++seq > count)
+				deadline = now + (int64_t)(UDP_TIMEOUT * 1e6);
+		}
+		while ((recv_bytes = recv(ping_socket, answer, (size_t)resp_size, 0)) >= 0) {
+			now = now_ns();
+			if (recv_bytes < LOSS_MINSIZE || sscanf(answer, "%d\n", &rseq) != 1 || rseq < 1 || rseq >= seq) {
+				++invalid;
+				continue;
+			}
+			received_before = round_trip.received;
+			seq_stats_add(&round_trip, rseq, now - get_timestamp(answer + PONG_CLIENT_TS_OFFSET));
+			if (round_trip.received > received_before)
+				hist_add(rtt_hist, now - get_timestamp(answer + PONG_CLIENT_TS_OFFSET));
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			++recv_errors; /* e.g. ICMP port unreachable: keep going */
+		now = now_ns();
+		if (seq > count && now >= deadline)
+			break;
+		if (seq <= count && now >= next_send)
+			continue;
+		now = (seq <= count ? next_send : deadline) - now;
+		wait.tv_sec = now / 1000000000;
+		wait.tv_nsec = now % 1000000000;
+		if (ppoll(&pfd, 1, &wait, NULL) < 0 && errno != EINTR)
+			fail_errno("UDP Ping cannot poll its socket");
+		now = now_ns();
+	}
+
+	if (blocking_write_all(control_socket, "END\n", 4) != 4)
+		fail_errno("UDP Ping cannot end the loss test");
+	if (read_line(control_socket, stats_line, sizeof stats_line) < 0
+	    || sscanf(stats_line, "STATS sent=%llu invalid=%llu %n", &server_sent, &server_invalid, &consumed) != 2
+	    || parse_seq_stats(stats_line + consumed, &uplink))
+		fail("UDP Ping received no statistics from Pong server");
+
+	printf("\nUDP Ping: loss test over %d datagrams of %d bytes, one every %lg ms\n", count, msg_size, opts->interval_ms);
+	printf("  round trip: sent %d (send errors %llu), answered %llu, lost %lld (%lg%%), duplicates %llu, reordered %llu (max extent %lld), too late %llu, invalid %llu, recv errors %llu, jitter %lg ms\n",
+	       count, send_errors, (unsigned long long)round_trip.received, (long long)(count - round_trip.received),
+	       100.0 * (double)(count - round_trip.received) / count, (unsigned long long)round_trip.duplicates,
+	       (unsigned long long)round_trip.reordered, (long long)round_trip.max_reorder,
+	       (unsigned long long)round_trip.too_late, invalid, recv_errors, round_trip.jitter_ns / 1e6);
+	printf("  uplink (server side): received %llu, lost %lld (%lg%%), duplicates %llu, reordered %llu (max extent %lld), too late %llu, invalid %llu, jitter %lg ms\n",
+	       (unsigned long long)uplink.received, (long long)(count - uplink.received),
+	       100.0 * (double)(count - uplink.received) / count, (unsigned long long)uplink.duplicates,
+	       (unsigned long long)uplink.reordered, (long long)uplink.max_reorder,
+	       (unsigned long long)uplink.too_late, server_invalid, uplink.jitter_ns / 1e6);
+	printf("  downlink: answers sent %llu, received %llu, lost %lld\n",
+	       server_sent, (unsigned long long)(round_trip.received + round_trip.duplicates),
+	       (long long)(server_sent - round_trip.received - round_trip.duplicates));
+	print_hist_percentiles(stdout, "  RTT (ms)", rtt_hist);
+	if (opts->sketch_path) {
+		FILE *f = fopen(opts->sketch_path, "a");
+		if (f == NULL || hist_write(f, "udp", msg_size, resp_size, rtt_hist) || fclose(f))
+			fail_errno("UDP Ping cannot write the RTT sketch");
+	}
+	free(rtt_hist);
+}
+
 int main(int argc, char *argv[])
 {
 	struct addrinfo gai_hints, *server_addrinfo;
@@ -159,21 +361,115 @@ int main(int argc, char *argv[])
 	int gai_rv;
 	char ipstr[INET_ADDRSTRLEN];
 	struct sockaddr_in *ipv4;
-	char request[40], answer[10];
+	char request[MAX_REQ], answer[MAX_ANSW];
 	ssize_t nr;
-	int pong_port;
-
+	int pong_port, ping_port = -1;
+	int session_mode = 0, opt;
+	struct ping_options opts;
+	int sizes[MAXSIZES], n_sizes, i;
+	const char *replay = NULL;
+	double gap_us = 0.0;
+	static struct workload workload;
+	static const struct option long_options[] = {
+		{"session", no_argument, NULL, 's'},
+		{"response", required_argument, NULL, 'r'},
+		{"timestamps", no_argument, NULL, 't'},
+		{"synced", no_argument, NULL, 'S'},
+		{"loss", no_argument, NULL, 'l'},
+		{"interval", required_argument, NULL, 'i'},
+		{"sketch", required_argument, NULL, 'k'},
+		{"trace", required_argument, NULL, 'Q'},
+		{"perf", no_argument, NULL, 'E'},
+		{"replay", required_argument, NULL, 'W'},
+		{"gap", required_argument, NULL, 'G'},
+		{"sockopt", required_argument, NULL, 'O'},
+		{NULL, 0, NULL, 0}
+	};
+
+	memset(&opts, 0, sizeof opts);
+	opts.interval_ms = LOSS_INTERVAL;
+	while ((opt = getopt_long(argc, argv, "sr:tli:k:", long_options, NULL)) != -1)
+		switch (opt) {
+		case 's':
+			session_mode = 1;
+			break;
+		case 'r':
+			if (sscanf(optarg, "%d", &opts.resp_size) != 1 || opts.resp_size < MINSIZE || opts.resp_size > MAXUDPSIZE)
+				fail("Wrong response size");
+			break;
+		case 't':
+			opts.timestamps = 1;
+			break;
+		case 'S':
+			opts.synced_clocks = 1;
+			break;
+		case 'l':
+			opts.loss = 1;
+			break;
+		case 'i':
+			if (sscanf(optarg, "%lf", &opts.interval_ms) != 1 || opts.interval_ms < 0.0)
+				fail("Wrong interval");
+			break;
+		case 'k':
+			opts.sketch_path = optarg;
+			break;
+		case 'Q':
+			trace_start(optarg, "udp_ping");
+			break;
+		case 'E':
+			opts.perf = 1;
+			break;
+		case 'W':
+			replay = optarg;
+			break;
+		case 'G':
+			if (sscanf(optarg, "%lf", &gap_us) != 1 || gap_us < 0.0)
+				fail("Wrong gap between datagrams");
+			break;
+		case 'O':
+			if (parse_sock_options(optarg, &opts.sockopts) || (opts.sockopts.set & SOCKOPT_TCP_ONLY))
+				fail("Wrong socket options (nodelay, quickack and cork are TCP only)");
+			opts.sockopt_spec = optarg;
+			break;
+		default:
+			fail("Incorrect parameters provided. Use: udp_ping [-s] [-r RESP_SIZE] [-t [--synced]] [-l [-i MS]] [-k SKETCH_FILE] [--trace FILE] [--perf] [--replay WORKLOAD [--gap US]] [--sockopt LIST] PONG_ADDR PONG_PORT MESSAGE_SIZE[,SIZE...] [NO_REPEAT]\n");
+		}
+	/*** from here on argv[1..] are the positional parameters ***/
+	argc -= optind - 1;
+	argv += optind - 1;
 	if (argc < 4)
-		fail("Incorrect parameters provided. Use: udp_ping PONG_ADDR PONG_PORT MESSAGE_SIZE [NO_REPEAT]\n");
+		fail("Incorrect parameters provided. Use: udp_ping [-s] [-r RESP_SIZE] [-t [--synced]] [-l [-i MS]] [-k SKETCH_FILE] [--trace FILE] [--perf] [--replay WORKLOAD [--gap US]] [--sockopt LIST] PONG_ADDR PONG_PORT MESSAGE_SIZE[,SIZE...] [NO_REPEAT]\n");
 	for (nr = 4, norep = REPEATS; nr < argc; nr++)
 		if (*argv[nr] >= '1' && *argv[nr] <= '9')
 			sscanf(argv[nr], "%d", &norep);
-	if (norep < MINREPEATS)
-		norep = MINREPEATS;
-	else if (norep > MAXREPEATS)
-		norep = MAXREPEATS;
-	if (sscanf(argv[3], "%d", &msg_size) != 1 || msg_size < MINSIZE || msg_size > MAXUDPSIZE)
+	/*** a loss test is not bounded: it runs in constant memory ***/
+	if (!opts.loss) {
+		if (norep < MINREPEATS)
+			norep = MINREPEATS;
+		else if (norep > MAXREPEATS)
+			norep = MAXREPEATS;
+	}
+	if ((n_sizes = parse_size_list(argv[3], sizes, MAXSIZES)) < 0)
 		fail("Wrong message size");
+	for (i = 0; i < n_sizes; i++)
+		if (sizes[i] < MINSIZE || sizes[i] > MAXUDPSIZE)
+			fail("Wrong message size");
+		else if (opts.timestamps && response_size(sizes[i], &opts) < PONG_TS_MINSIZE)
+			fail("Server timestamps need responses of at least 32 bytes");
+		else if (opts.loss && (sizes[i] < LOSS_MINSIZE || response_size(sizes[i], &opts) < LOSS_MINSIZE))
+			fail("Loss tests need messages and responses of at least 40 bytes");
+	/*** a replay is a single "var=1" test: MESSAGE_SIZE bounds its datagrams ***/
+	if (replay) {
+		if (n_sizes > 1 || opts.resp_size || opts.timestamps || opts.loss || opts.sketch_path || opts.perf)
+			fail("A replay has a single maximum size and no response size, timestamps, loss test, sketch or counters");
+		load_workload(replay, norep, gap_us, sizes[0], &workload);
+		sizes[0] = workload.max_size;
+		norep = workload.n;
+		opts.variable = 1;
+	}
+	/*** a sweep over several sizes shares one control session ***/
+	if (n_sizes > 1)
+		session_mode = 1;
 
     /*** Specify TCP socket options ***/
 	memset(&gai_hints, 0, sizeof gai_hints);
@@ -216,60 +512,71 @@ int main(int argc, char *argv[])
 /*** TO BE DONE END ***/
 
 	freeaddrinfo(server_addrinfo);
-	printf(" ... connected to Pong server: asking for %d repetitions of %d _bytes UDP messages\n", norep, msg_size);
-	sprintf(request, "UDP %d %d\n", msg_size, norep);
-
-    /*** Write the request on the TCP socket ***/
-/** TO BE DONE START ***/
-	size_t request_len = strlen(request);
-	if(request_len > MAX_REQ)
-		fail("Request too long");
-
-	if (write(ask_socket, request, request_len) != request_len)
-		fail_errno("Error writing request on socket");
+	if (session_mode && start_session(ask_socket))
+		fail("UDP Ping: Pong server refused the control session");
+	for (i = 0; i < n_sizes; i++) {
+		msg_size = sizes[i];
+		if (opts.variable)
+			printf(" ... connected to Pong server: replaying %d UDP datagrams of up to %d bytes\n", norep, msg_size);
+		else
+			printf(" ... connected to Pong server: asking for %d repetitions of %d _bytes UDP messages\n", norep, msg_size);
+		build_request(request, "UDP", msg_size, norep, &opts);
 
+		/*** Write the request on the TCP socket ***/
+		/** TO BE DONE START ***/
+		size_t request_len = strlen(request);
+		if(request_len > MAX_REQ)
+			fail("Request too long");
 
-/*** TO BE DONE END ***/
+		if (write(ask_socket, request, request_len) != request_len)
+			fail_errno("Error writing request on socket");
 
-	nr = read(ask_socket, answer, sizeof(answer));
-	if (nr < 0)
-		fail_errno("UDP Ping could not receive answer from Pong server");
-	if (nr==sizeof(answer))
-		--nr;
-	answer[nr] = 0;
 
-    /*** Check if the answer is OK, and fail if it is not ***/
-/*** TO BE DONE START ***/
-	if (strncmp(answer, "OK", 2) != 0)
-		fail("UDP Ping received an unexpected answer from Pong server");
+		/*** TO BE DONE END ***/
 
-/*** TO BE DONE END ***/
+		nr = read_line(ask_socket, answer, sizeof(answer));
+		if (nr < 0)
+			fail_errno("UDP Ping could not receive answer from Pong server");
 
-    /*** else ***/
-	sscanf(answer + 3, "%d\n", &pong_port);
-	printf(" ... Pong server agreed to ping-pong using port %d :-)\n", pong_port);
-	sprintf(answer, "%d", pong_port);
-	shutdown(ask_socket, SHUT_RDWR);
-	close(ask_socket);
+		/*** Check if the answer is OK, and fail if it is not ***/
+		/*** TO BE DONE START ***/
+		if (strncmp(answer, "OK", 2) != 0)
+			fail("UDP Ping received an unexpected answer from Pong server");
 
-	ping_socket = prepare_udp_socket(argv[1], answer);
+		/*** TO BE DONE END ***/
 
-	{
-		char message[msg_size];
-		memset(&message, 0, (size_t)msg_size);
-		double ping_times[norep];
-		struct timespec zero, resolution;
-		int repeat;
-		for (repeat = 0; repeat < norep; repeat++) {
-			ping_times[repeat] = do_ping((size_t)msg_size, repeat + 1, message, ping_socket, UDP_TIMEOUT);
-			printf("Round trip time was %6.3lf milliseconds in repetition %d\n", ping_times[repeat], repeat + 1);
+		/*** else ***/
+		sscanf(answer + 3, "%d\n", &pong_port);
+		printf(" ... Pong server agreed to ping-pong using port %d :-)\n", pong_port);
+		if (!session_mode && !opts.loss) {
+			shutdown(ask_socket, SHUT_RDWR);
+			close(ask_socket);
 		}
-		memset((void *)(&zero), 0, sizeof(struct timespec));
-		if (clock_getres(CLOCK_TYPE, &resolution) != 0)
-			fail_errno("UDP Ping could not get timer resolution");
-		print_statistics(stdout, "UDP Ping: ", norep, ping_times, msg_size, timespec_delta2milliseconds(&resolution, &zero));
 
+		/*** within a session the server keeps its UDP socket: so does the client ***/
+		if (pong_port != ping_port) {
+			if (ping_port >= 0)
+				close(ping_socket);
+			sprintf(answer, "%d", pong_port);
+			ping_socket = prepare_udp_socket(argv[1], answer);
+			ping_port = pong_port;
+			if (apply_sock_options(ping_socket, 0, &opts.sockopts))
+				fail_errno("UDP Ping cannot set the socket options");
+		} else
+			while (recv(ping_socket, answer, sizeof answer, 0) >= 0)
+				; /* late answers of the previous test */
+
+		if (opts.loss)
+			run_loss_test(ping_socket, ask_socket, msg_size, norep, &opts);
+		else if (opts.variable)
+			run_replay(ping_socket, &workload);
+		else
+			run_pings(ping_socket, msg_size, norep, &opts);
 	}
+	if (session_mode)
+		end_session(ask_socket);
+	if (session_mode || opts.loss)
+		close(ask_socket);
 
 	close(ping_socket);
 	exit(EXIT_SUCCESS);
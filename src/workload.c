@@ -0,0 +1,210 @@
+/*
+ * workload.c: carichi di lavoro da riprodurre (tcp_ping/udp_ping --replay)
+ *             con messaggi di dimensione variabile: distribuzioni delle
+ *             dimensioni (istogramma, uniforme, lognormale, esponenziale)
+ *             o tracce registrate di dimensioni e intervalli di arrivo;
+ *             RTT riportati per classi di dimensione.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <math.h>
+#include "pingpong.h"
+
+#define WORKLOAD_SEED 0x5eed	/* the same spec always gives the same messages */
+#define MAXBINS 1024		/* lines of a histogram file */
+
+static FILE *open_workload(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		fail_errno(path);
+	return f;
+}
+
+/* Next line that is neither empty nor a "#" comment, NULL at the end */
+static char *next_line(FILE *f, char *line, int size)
+{
+	char *p;
+	while (fgets(line, size, f)) {
+		for (p = line; *p == ' ' || *p == '\t'; p++)
+			;
+		if (*p != '#' && *p != '\n' && *p)
+			return p;
+	}
+	return NULL;
+}
+
+static int clamp_size(double size, int max_size)
+{
+	if (size < MINSIZE)
+		return MINSIZE;
+	if (size > max_size)
+		return max_size;
+	return (int)(size + 0.5);
+}
+
+/* "SIZE [GAP_US]" per line: the trace is replayed once, as recorded */
+static void load_trace(const char *path, int max_size, struct workload *w)
+{
+	FILE *f = open_workload(path);
+	char line[128], *p;
+	double size, gap_us;
+	int fields;
+
+	while ((p = next_line(f, line, sizeof line)) != NULL) {
+		if ((fields = sscanf(p, "%lf %lf", &size, &gap_us)) < 1 || size < 1.0 || (fields == 2 && gap_us < 0.0))
+			fail("Invalid line in the workload trace");
+		if (w->n == MAXREPEATS) {
+			fprintf(stderr, "Workload trace %s: only the first %d messages are replayed\n", path, MAXREPEATS);
+			break;
+		}
+		w->sizes[w->n] = clamp_size(size, max_size);
+		w->gaps_ns[w->n++] = fields == 2 ? (int64_t)(gap_us * 1e3) : 0;
+	}
+	fclose(f);
+	if (w->n == 0)
+		fail("Empty workload trace");
+}
+
+/* "SIZE WEIGHT" per line: sizes are drawn with probability proportional to WEIGHT */
+static void load_histogram(const char *path, int count, int max_size, unsigned short rand_state[3], struct workload *w)
+{
+	FILE *f = open_workload(path);
+	static double sizes[MAXBINS], cumulative[MAXBINS];
+	char line[128], *p;
+	double weight, total = 0.0, u;
+	int n_bins = 0, i, k;
+
+	while ((p = next_line(f, line, sizeof line)) != NULL) {
+		if (n_bins == MAXBINS || sscanf(p, "%lf %lf", &sizes[n_bins], &weight) != 2 || sizes[n_bins] < 1.0 || weight < 0.0)
+			fail("Invalid line in the workload histogram");
+		total += weight;
+		cumulative[n_bins++] = total;
+	}
+	fclose(f);
+	if (total <= 0.0)
+		fail("Empty workload histogram");
+	for (i = 0; i < count; i++) {
+		u = erand48(rand_state) * total;
+		for (k = 0; k < n_bins - 1 && cumulative[k] <= u; k++)
+			;
+		w->sizes[i] = clamp_size(sizes[k], max_size);
+	}
+	w->n = count;
+}
+
+static double normal(unsigned short rand_state[3])
+{
+	const double u = 1.0 - erand48(rand_state), v = erand48(rand_state);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/*
+ * Fills w from spec, one of
+ *   trace:FILE		"SIZE [GAP_US]" per line, replayed once (count is ignored)
+ *   hist:FILE		"SIZE WEIGHT" per line
+ *   uniform:MIN:MAX
+ *   lognormal:MEDIAN:SIGMA	sigma of the natural logarithm of the size
+ *   exp:MEAN
+ * Distributions give count messages; with gap_us > 0 they are sent at
+ * exponentially distributed intervals of that mean (Poisson arrivals),
+ * back to back otherwise. Sizes are clamped to [MINSIZE, max_size] and
+ * everything is drawn here, so the replay loop itself only sends.
+ */
+void load_workload(const char *spec, int count, double gap_us, int max_size, struct workload *w)
+{
+	unsigned short rand_state[3] = { 0x330e, WORKLOAD_SEED, 0 };
+	double a, b;
+	int i;
+
+	memset(w, 0, sizeof *w);
+	if (count > MAXREPEATS)
+		count = MAXREPEATS;
+	if (strncmp(spec, "trace:", 6) == 0)
+		load_trace(spec + 6, max_size, w);
+	else if (strncmp(spec, "hist:", 5) == 0)
+		load_histogram(spec + 5, count, max_size, rand_state, w);
+	else {
+		if (sscanf(spec, "uniform:%lf:%lf", &a, &b) == 2 && a >= 1.0 && b >= a) {
+			for (i = 0; i < count; i++)
+				w->sizes[i] = clamp_size(a + erand48(rand_state) * (b - a + 1.0) - 0.5, max_size);
+		} else if (sscanf(spec, "lognormal:%lf:%lf", &a, &b) == 2 && a >= 1.0 && b >= 0.0) {
+			for (i = 0; i < count; i++)
+				w->sizes[i] = clamp_size(a * exp(b * normal(rand_state)), max_size);
+		} else if (sscanf(spec, "exp:%lf", &a) == 1 && a >= 1.0) {
+			for (i = 0; i < count; i++)
+				w->sizes[i] = clamp_size(-a * log(1.0 - erand48(rand_state)), max_size);
+		} else
+			fail("Workload must be trace:FILE, hist:FILE, uniform:MIN:MAX, lognormal:MEDIAN:SIGMA or exp:MEAN");
+		w->n = count;
+	}
+	if (gap_us > 0.0 && strncmp(spec, "trace:", 6) != 0)
+		for (i = 0; i < w->n; i++)
+			w->gaps_ns[i] = (int64_t)(-gap_us * 1e3 * log(1.0 - erand48(rand_state)));
+	for (i = 0; i < w->n; i++)
+		if (w->sizes[i] > w->max_size)
+			w->max_size = w->sizes[i];
+}
+
+/*
+ * Waits until *next_ns + gap_ns, the scheduled send time of the next
+ * message, and makes it the new *next_ns. A message whose time has
+ * already passed (the previous answer came late) is sent at once: the
+ * schedule is kept, so the following ones catch up.
+ */
+void workload_wait(int64_t *next_ns, int64_t gap_ns)
+{
+	struct timespec t;
+	if (gap_ns == 0)
+		return;
+	*next_ns += gap_ns;
+	if (now_ns() >= *next_ns)
+		return;
+	t.tv_sec = (time_t)(*next_ns / 1000000000);
+	t.tv_nsec = (long)(*next_ns % 1000000000);
+	while (clock_nanosleep(CLOCK_TYPE, TIMER_ABSTIME, &t, NULL) == EINTR)
+		;
+}
+
+/*
+ * Percentiles of the RTTs of the replay by size class (powers of two),
+ * then over all the messages.
+ */
+void print_workload_report(FILE * outf, const char *name, const struct workload *w, const double rtt[])
+{
+	double v[w->n], mean_size = 0.0;
+	char label[128];
+	int lo, i, n;
+
+	fprintf(outf, "\n%s RTT (ms) by message size over %d messages\n", name, w->n);
+	for (lo = MINSIZE; lo <= w->max_size; lo *= 2) {
+		for (i = n = 0; i < w->n; i++)
+			if (w->sizes[i] >= lo && w->sizes[i] < 2 * lo)
+				v[n++] = rtt[i];
+		if (n == 0)
+			continue;
+		snprintf(label, sizeof label, "%s %d-%d bytes (%d messages)", name, lo, 2 * lo - 1, n);
+		print_percentiles(outf, label, n, v);
+	}
+	for (i = 0; i < w->n; i++) {
+		v[i] = rtt[i];
+		mean_size += (w->sizes[i] - mean_size) / (i + 1);
+	}
+	snprintf(label, sizeof label, "%s all sizes (mean %.0lf bytes)", name, mean_size);
+	print_percentiles(outf, label, w->n, v);
+}
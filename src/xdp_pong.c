@@ -0,0 +1,498 @@
+/*
+ * xdp_pong.c: percorso veloce AF_XDP per il pong UDP (pong_server -x).
+ *             Un programma XDP caricato sull'interfaccia devia verso un
+ *             socket AF_XDP solo i datagrammi diretti alle porte dei test
+ *             UDP in corso; un processo dedicato li rimanda indietro
+ *             direttamente dalla UMEM, senza attraversare lo stack UDP del
+ *             kernel. Tutti gli altri pacchetti proseguono normalmente.
+ *
+ * versione 24.1
+ *
+ * Programma sviluppato a supporto del laboratorio di
+ * Sistemi di Elaborazione e Trasmissione del corso di laurea
+ * in Informatica classe L-31 presso l'Universita` degli Studi di
+ * Genova, anno accademico 2024/2025.
+ *
+ * Copyright (C) 2013-2014 by Giovanni Chiola <chiolag@acm.org>
+ * Copyright (C) 2015-2016 by Giovanni Lagorio <giovanni.lagorio@unige.it>
+ * Copyright (C) 2017-2024 by Giovanni Chiola <chiolag@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <stddef.h>
+#include <poll.h>
+#include <signal.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include "pingpong.h"
+
+#define XSK_FRAMES 2048		/* UMEM frames, also the size of every ring */
+#define XSK_FRAME_SIZE 4096
+#define XSK_BATCH 64		/* descriptors handled per ring pass */
+#define XSK_MAX_QUEUES 64
+#define XDP_HDR_LEN 42		/* Ethernet, IPv4 without options and UDP headers */
+#define XDP_NOTICE "XDPDONE\n"
+
+/*
+ * One of the four rings shared with the kernel. Producer and consumer are
+ * free-running indices: the kernel reads the ones we write, and the other
+ * way round, with acquire/release ordering.
+ */
+struct xsk_ring {
+	uint32_t *producer, *consumer;
+	void *descs;
+	uint32_t mask;
+	void *map;
+	size_t map_len;
+};
+
+struct xsk_engine {
+	int xsk_fd, link_fd, notice_fd;
+	char *umem;
+	struct xsk_ring rx, tx, fill, comp;
+};
+
+/*
+ * Steering table, indexed by the UDP port as it is stored in the packet
+ * (network byte order): the last sequence number of the test served on
+ * that port, 0 if the port is not steered. It is a BPF array map mmap()ed
+ * by the server before any fork(), so the pong children, the engine and
+ * the XDP program all see the same memory.
+ */
+static uint64_t *port_slots;
+
+static long sys_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof *attr);
+}
+
+static int create_map(uint32_t type, uint32_t value_size, uint32_t max_entries, uint32_t flags)
+{
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof attr);
+	attr.map_type = type;
+	attr.key_size = sizeof(uint32_t);
+	attr.value_size = value_size;
+	attr.max_entries = max_entries;
+	attr.map_flags = flags;
+	return (int)sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+#define INSN(c, d, s, o, i) ((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define LD_MAP_FD(d, fd) INSN(BPF_LD | BPF_DW | BPF_IMM, d, BPF_PSEUDO_MAP_FD, 0, fd), INSN(0, 0, 0, 0, 0)
+#define PASS_LABEL 31		/* index of the "return XDP_PASS" instruction */
+#define TO_PASS(i) (PASS_LABEL - (i) - 1)
+
+/*
+ * The XDP program, written directly in BPF instructions so that neither
+ * libbpf nor a BPF compiler are needed:
+ *
+ *	if (IPv4 without options && UDP && !fragment && port_slots[dst port])
+ *		return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+ *	return XDP_PASS;
+ *
+ * The XDP_PASS flag of the redirect hands the packet to the kernel when
+ * no AF_XDP socket serves its queue.
+ */
+static int load_program(int slots_fd, int xsks_fd)
+{
+	const struct bpf_insn prog[] = {
+		/* 0 */ INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+		/* 1 */ INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data), 0),
+		/* 2 */ INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_6, offsetof(struct xdp_md, data_end), 0),
+		/* 3 */ INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+		/* 4 */ INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, XDP_HDR_LEN),
+		/* 5 */ INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, TO_PASS(5), 0),
+		/* 6 */ INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0),	/* EtherType */
+		/* 7 */ INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, TO_PASS(7), htons(ETH_P_IP)),
+		/* 8 */ INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 14, 0),	/* version, IHL */
+		/* 9 */ INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, TO_PASS(9), 0x45),
+		/* 10 */ INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 23, 0),	/* protocol */
+		/* 11 */ INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, TO_PASS(11), IPPROTO_UDP),
+		/* 12 */ INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 20, 0),	/* MF flag, fragment offset */
+		/* 13 */ INSN(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(0x3fff)),
+		/* 14 */ INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, TO_PASS(14), 0),
+		/* 15 */ INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 36, 0),	/* UDP destination port */
+		/* 16 */ INSN(BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_5, -4, 0),
+		/* 17 */ INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0),
+		/* 18 */ INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -4),
+		/* 19 */ LD_MAP_FD(BPF_REG_1, slots_fd),
+		/* 21 */ INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+		/* 22 */ INSN(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, TO_PASS(22), 0),
+		/* 23 */ INSN(BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_0, BPF_REG_0, 0, 0),
+		/* 24 */ INSN(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, TO_PASS(24), 0),
+		/* 25 */ INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0),
+		/* 26 */ LD_MAP_FD(BPF_REG_1, xsks_fd),
+		/* 28 */ INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+		/* 29 */ INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+		/* 30 */ INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+		/* 31 */ INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+		/* 32 */ INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+	};
+	static char log[4096];
+	union bpf_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof attr);
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (uintptr_t)prog;
+	attr.insn_cnt = sizeof prog / sizeof prog[0];
+	attr.license = (uintptr_t)"GPL";
+	attr.log_buf = (uintptr_t)log;
+	attr.log_size = sizeof log;
+	attr.log_level = 1;
+	attr.expected_attach_type = BPF_XDP;
+	if ((fd = (int)sys_bpf(BPF_PROG_LOAD, &attr)) < 0 && log[0])
+		fprintf(stderr, "BPF verifier:\n%s\n", log);
+	return fd;
+}
+
+/*
+ * Native (driver) mode when the interface supports it and *generic is 0,
+ * generic mode otherwise. *generic tells which one was used.
+ */
+static int attach_program(int prog_fd, int ifindex, int *generic)
+{
+	union bpf_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof attr);
+	attr.link_create.prog_fd = (uint32_t)prog_fd;
+	attr.link_create.target_ifindex = (uint32_t)ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	if (!*generic) {
+		attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+		if ((fd = (int)sys_bpf(BPF_LINK_CREATE, &attr)) >= 0)
+			return fd;
+	}
+	attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+	*generic = 1;
+	return (int)sys_bpf(BPF_LINK_CREATE, &attr);
+}
+
+static int map_ring(int fd, struct xsk_ring *r, const struct xdp_ring_offset *off, size_t desc_size, off_t pgoff)
+{
+	char *p;
+	r->map_len = off->desc + XSK_FRAMES * desc_size;
+	p = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (p == MAP_FAILED)
+		return -1;
+	r->map = p;
+	r->producer = (uint32_t *)(p + off->producer);
+	r->consumer = (uint32_t *)(p + off->consumer);
+	r->descs = p + off->desc;
+	r->mask = XSK_FRAMES - 1;
+	return 0;
+}
+
+/*
+ * The AF_XDP socket bound to ifindex/queue, with its UMEM: every frame
+ * starts in the fill ring and goes back to it from the completion ring
+ * once its echo has been sent.
+ */
+static int open_xsk(struct xsk_engine *e, int ifindex, int queue, int *zerocopy)
+{
+	struct xdp_umem_reg reg;
+	struct xdp_mmap_offsets off;
+	struct xdp_options opts;
+	struct sockaddr_xdp sxdp;
+	socklen_t len = sizeof off;
+	int ring_size = XSK_FRAMES;
+	uint64_t *fill;
+	uint32_t i;
+
+	if ((e->xsk_fd = socket(AF_XDP, SOCK_RAW, 0)) < 0)
+		return -1;
+	e->umem = mmap(NULL, (size_t)XSK_FRAMES * XSK_FRAME_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (e->umem == MAP_FAILED)
+		return -1;
+	memset(&reg, 0, sizeof reg);
+	reg.addr = (uintptr_t)e->umem;
+	reg.len = (uint64_t)XSK_FRAMES * XSK_FRAME_SIZE;
+	reg.chunk_size = XSK_FRAME_SIZE;
+	if (setsockopt(e->xsk_fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof reg) ||
+	    setsockopt(e->xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof ring_size) ||
+	    setsockopt(e->xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof ring_size) ||
+	    setsockopt(e->xsk_fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof ring_size) ||
+	    setsockopt(e->xsk_fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof ring_size) ||
+	    getsockopt(e->xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len))
+		return -1;
+	if (map_ring(e->xsk_fd, &e->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) ||
+	    map_ring(e->xsk_fd, &e->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) ||
+	    map_ring(e->xsk_fd, &e->fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) ||
+	    map_ring(e->xsk_fd, &e->comp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING))
+		return -1;
+	fill = e->fill.descs;
+	for (i = 0; i < XSK_FRAMES; i++)
+		fill[i] = (uint64_t)i * XSK_FRAME_SIZE;
+	__atomic_store_n(e->fill.producer, XSK_FRAMES, __ATOMIC_RELEASE);
+
+	/* no flags: zero-copy if the driver can do it, copy mode otherwise */
+	memset(&sxdp, 0, sizeof sxdp);
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = (uint32_t)ifindex;
+	sxdp.sxdp_queue_id = (uint32_t)queue;
+	if (bind(e->xsk_fd, (struct sockaddr *)&sxdp, sizeof sxdp))
+		return -1;
+	len = sizeof opts;
+	*zerocopy = getsockopt(e->xsk_fd, SOL_XDP, XDP_OPTIONS, &opts, &len) == 0 && (opts.flags & XDP_OPTIONS_ZEROCOPY);
+	return 0;
+}
+
+static void swap_bytes(char *a, char *b, size_t n)
+{
+	char tmp[6];
+	memcpy(tmp, a, n);
+	memcpy(a, b, n);
+	memcpy(b, tmp, n);
+}
+
+/* The sequence number at the start of a udp_ping payload, 0 if none */
+static uint32_t payload_seq(const char *p, const char *end)
+{
+	uint32_t seq = 0;
+	while (p < end && *p >= '0' && *p <= '9' && seq < 100000000)
+		seq = seq * 10 + (uint32_t)(*p++ - '0');
+	return seq;
+}
+
+/*
+ * Turns the datagram in the frame into its own echo: swapping the MAC
+ * addresses, the IP addresses and the UDP ports leaves the IP checksum
+ * valid. The UDP checksum may be just the partial sum of a sender with
+ * checksum offload (veth, for one), so it is dropped: 0 means "none" on
+ * IPv4. Returns the destination port slot when the datagram carried the
+ * last sequence number of its test, -1 otherwise.
+ */
+static int echo_frame(char *frame, uint32_t len)
+{
+	uint16_t port;
+	uint64_t last;
+	swap_bytes(frame, frame + 6, 6);
+	swap_bytes(frame + 26, frame + 30, 4);
+	swap_bytes(frame + 34, frame + 36, 2);
+	memset(frame + 40, 0, 2);
+	memcpy(&port, frame + 34, sizeof port);	/* was the destination port */
+	last = __atomic_load_n(&port_slots[port], __ATOMIC_RELAXED);
+	if (last && payload_seq(frame + XDP_HDR_LEN, frame + len) >= last) {
+		__atomic_store_n(&port_slots[port], 0, __ATOMIC_RELAXED);
+		return port;
+	}
+	return -1;
+}
+
+/* Completed echoes give their frames back to the fill ring */
+static void recycle_frames(struct xsk_engine *e)
+{
+	const uint32_t cons = *e->comp.consumer, prod = *e->fill.producer;
+	const uint32_t n = __atomic_load_n(e->comp.producer, __ATOMIC_ACQUIRE) - cons;
+	const uint64_t *done = e->comp.descs;
+	uint64_t *fill = e->fill.descs;
+	uint32_t i;
+	/* the fill ring holds every frame: there is always room */
+	for (i = 0; i < n; i++)
+		fill[(prod + i) & e->fill.mask] = done[(cons + i) & e->comp.mask];
+	__atomic_store_n(e->fill.producer, prod + n, __ATOMIC_RELEASE);
+	__atomic_store_n(e->comp.consumer, cons + n, __ATOMIC_RELEASE);
+}
+
+/* The test on port (network byte order) is over: tell its pong child */
+static void send_notice(int notice_fd, uint16_t port)
+{
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = port;
+	sendto(notice_fd, XDP_NOTICE, strlen(XDP_NOTICE), 0, (struct sockaddr *)&addr, sizeof addr);
+}
+
+static void engine_loop(struct xsk_engine *e)
+{
+	struct pollfd pfd = { e->xsk_fd, POLLIN, 0 };
+	struct xdp_desc *rx = e->rx.descs, *tx = e->tx.descs;
+	int ended[XSK_BATCH];
+
+	for (;;) {
+		uint32_t rx_cons, tx_prod, tx_free, n, i;
+		int n_ended = 0;
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			fail_errno("XDP Pong cannot poll its socket");
+		}
+		recycle_frames(e);
+		rx_cons = *e->rx.consumer;
+		tx_prod = *e->tx.producer;
+		n = __atomic_load_n(e->rx.producer, __ATOMIC_ACQUIRE) - rx_cons;
+		tx_free = XSK_FRAMES - (tx_prod - __atomic_load_n(e->tx.consumer, __ATOMIC_ACQUIRE));
+		if (n > tx_free)
+			n = tx_free;
+		if (n > XSK_BATCH)
+			n = XSK_BATCH;
+		/*** every received frame goes back out as it is, from the same UMEM address ***/
+		for (i = 0; i < n; i++) {
+			const struct xdp_desc *d = &rx[(rx_cons + i) & e->rx.mask];
+			int port = echo_frame(e->umem + d->addr, d->len);
+			if (port >= 0)
+				ended[n_ended++] = port;
+			tx[(tx_prod + i) & e->tx.mask] = *d;
+		}
+		__atomic_store_n(e->rx.consumer, rx_cons + n, __ATOMIC_RELEASE);
+		__atomic_store_n(e->tx.producer, tx_prod + n, __ATOMIC_RELEASE);
+		if (n && sendto(e->xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+		    errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN)
+			fail_errno("XDP Pong cannot transmit");
+		recycle_frames(e);
+		for (i = 0; i < (uint32_t)n_ended; i++)
+			send_notice(e->notice_fd, (uint16_t)ended[i]);
+	}
+}
+
+/* Undoes open_xsk() and the attachment, in reverse order: what was not set up is -1 or NULL */
+static void close_engine(struct xsk_engine *e)
+{
+	struct xsk_ring *const rings[] = { &e->comp, &e->fill, &e->tx, &e->rx };
+	size_t i;
+
+	if (e->notice_fd >= 0)
+		close(e->notice_fd);
+	if (e->link_fd >= 0)
+		close(e->link_fd);	/* detaches the XDP program */
+	for (i = 0; i < sizeof rings / sizeof rings[0]; i++)
+		if (rings[i]->map)
+			munmap(rings[i]->map, rings[i]->map_len);
+	if (e->umem && e->umem != MAP_FAILED)
+		munmap(e->umem, (size_t)XSK_FRAMES * XSK_FRAME_SIZE);
+	if (e->xsk_fd >= 0)
+		close(e->xsk_fd);
+}
+
+/*
+ * Loads the XDP program on ifname (in generic mode if asked to, or if
+ * the driver has no XDP support), binds an AF_XDP socket to the queue and
+ * forks the echo engine, which lives as long as the server. Returns 0, or
+ * -1 with a message on stderr: the server then keeps using the socket
+ * path only.
+ */
+int xdp_pong_start(const char *ifname, int queue, int generic)
+{
+	struct xsk_engine e;
+	union bpf_attr attr;
+	int ifindex, slots_fd = -1, xsks_fd = -1, prog_fd = -1, zerocopy;
+	uint32_t key = (uint32_t)queue;
+	pid_t pid;
+
+	memset(&e, 0, sizeof e);
+	e.xsk_fd = e.link_fd = e.notice_fd = -1;
+	if ((ifindex = (int)if_nametoindex(ifname)) == 0) {
+		fprintf(stderr, "XDP Pong: no interface %s\n", ifname);
+		return -1;
+	}
+	if (queue < 0 || queue >= XSK_MAX_QUEUES) {
+		fprintf(stderr, "XDP Pong: queue %d out of range\n", queue);
+		return -1;
+	}
+	if ((slots_fd = create_map(BPF_MAP_TYPE_ARRAY, sizeof(uint64_t), 65536, BPF_F_MMAPABLE)) < 0 ||
+	    (xsks_fd = create_map(BPF_MAP_TYPE_XSKMAP, sizeof(int), XSK_MAX_QUEUES, 0)) < 0) {
+		perror("XDP Pong cannot create its BPF maps");
+		goto error;
+	}
+	port_slots = mmap(NULL, 65536 * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, slots_fd, 0);
+	if (port_slots == MAP_FAILED) {
+		perror("XDP Pong cannot map the steering table");
+		port_slots = NULL;
+		goto error;
+	}
+	if ((prog_fd = load_program(slots_fd, xsks_fd)) < 0) {
+		perror("XDP Pong cannot load the XDP program");
+		goto error;
+	}
+	if (open_xsk(&e, ifindex, queue, &zerocopy)) {
+		perror("XDP Pong cannot set up the AF_XDP socket");
+		goto error;
+	}
+	memset(&attr, 0, sizeof attr);
+	attr.map_fd = (uint32_t)xsks_fd;
+	attr.key = (uintptr_t)&key;
+	attr.value = (uintptr_t)&e.xsk_fd;
+	if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr)) {
+		perror("XDP Pong cannot register the AF_XDP socket");
+		goto error;
+	}
+	if ((e.link_fd = attach_program(prog_fd, ifindex, &generic)) < 0) {
+		perror("XDP Pong cannot attach the XDP program");
+		goto error;
+	}
+	if ((e.notice_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		perror("XDP Pong cannot open its notice socket");
+		goto error;
+	}
+	fprintf(stderr, "XDP Pong on %s queue %d, %s mode, %s\n", ifname, queue,
+		generic ? "generic (SKB)" : "native", zerocopy ? "zero-copy" : "copy");
+	if ((pid = fork()) < 0)
+		fail_errno("XDP Pong could not fork");
+	if (pid == 0) {
+		/* the program stays attached until the link is closed, i.e. until the engine exits */
+		if (prctl(PR_SET_PDEATHSIG, SIGTERM))
+			fail_errno("XDP Pong cannot follow the server's death");
+		if (getppid() == 1)
+			exit(EXIT_SUCCESS);
+		engine_loop(&e);
+	}
+	close_engine(&e);
+	close(prog_fd);
+	close(xsks_fd);
+	close(slots_fd);
+	return 0;
+
+error:
+	/* the server goes on without XDP: nothing may stay attached or allocated */
+	close_engine(&e);
+	if (prog_fd >= 0)
+		close(prog_fd);
+	if (port_slots) {
+		munmap(port_slots, 65536 * sizeof(uint64_t));
+		port_slots = NULL;
+	}
+	if (xsks_fd >= 0)
+		close(xsks_fd);
+	if (slots_fd >= 0)
+		close(slots_fd);
+	return -1;
+}
+
+int xdp_pong_active(void)
+{
+	return port_slots != NULL;
+}
+
+/*
+ * Steers the datagrams for a UDP port (host byte order) to the engine
+ * until the one carrying sequence number last_seq has been echoed; 0
+ * stops the steering.
+ */
+void xdp_pong_steer(int port, int last_seq)
+{
+	if (port_slots)
+		__atomic_store_n(&port_slots[htons((uint16_t)port)], (uint64_t)last_seq, __ATOMIC_RELEASE);
+}
+
+/* Is this datagram the engine's notice that the test is over? */
+int xdp_pong_is_notice(const char *dgram, size_t len, const struct sockaddr_storage *from)
+{
+	const struct sockaddr_in *sin = (const struct sockaddr_in *)from;
+	return len == strlen(XDP_NOTICE) && memcmp(dgram, XDP_NOTICE, len) == 0 && sin->sin_family == AF_INET &&
+		sin->sin_addr.s_addr == htonl(INADDR_LOOPBACK);
+}